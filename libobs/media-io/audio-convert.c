@@ -0,0 +1,589 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+#include <math.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#include "../util/bmem.h"
+#include "../util/darray.h"
+#include "audio-convert.h"
+
+/* ------------------------------------------------------------------------- */
+/* sample format conversion.  everything is converted through 32bit float,
+ * one channel at a time. */
+
+/* volume is applied as part of the conversion so the data only needs to be
+ * touched once.  contiguous (planar) data and interleaved stereo float are
+ * vectorized, anything else falls back to the scalar loops. */
+
+static void conv_float_to_float(float *out, const float *in, size_t stride,
+		size_t frames, float volume)
+{
+	__m128 vol = _mm_set1_ps(volume);
+	size_t i = 0;
+
+	if (stride == 1) {
+		if (volume == 1.0f) {
+			memcpy(out, in, frames * sizeof(float));
+			return;
+		}
+
+		for (; i + 4 <= frames; i += 4)
+			_mm_storeu_ps(out + i,
+					_mm_mul_ps(_mm_loadu_ps(in + i), vol));
+
+	} else if (stride == 2) {
+		/* the caller already offset the input for the channel, so
+		 * the channel's samples are always the even ones.  the second
+		 * load reaches one sample past the channel's last one, which
+		 * is past the end of the buffer for the last channel, so the
+		 * last group is always left to the scalar loop */
+		for (; i + 4 < frames; i += 4) {
+			__m128 a = _mm_loadu_ps(in + i * 2);
+			__m128 b = _mm_loadu_ps(in + i * 2 + 4);
+			__m128 val = _mm_shuffle_ps(a, b,
+					_MM_SHUFFLE(2, 0, 2, 0));
+			_mm_storeu_ps(out + i, _mm_mul_ps(val, vol));
+		}
+	}
+
+	for (; i < frames; i++)
+		out[i] = in[i * stride] * volume;
+}
+
+static void conv_s16_to_float(float *out, const int16_t *in, size_t stride,
+		size_t frames, float volume)
+{
+	float  scale = volume / 32768.0f;
+	__m128 vol   = _mm_set1_ps(scale);
+	size_t i     = 0;
+
+	if (stride == 1) {
+		for (; i + 8 <= frames; i += 8) {
+			__m128i val = _mm_loadu_si128((const __m128i*)(in + i));
+			__m128i lo  = _mm_srai_epi32(
+					_mm_unpacklo_epi16(val, val), 16);
+			__m128i hi  = _mm_srai_epi32(
+					_mm_unpackhi_epi16(val, val), 16);
+
+			_mm_storeu_ps(out + i,
+					_mm_mul_ps(_mm_cvtepi32_ps(lo), vol));
+			_mm_storeu_ps(out + i + 4,
+					_mm_mul_ps(_mm_cvtepi32_ps(hi), vol));
+		}
+	}
+
+	for (; i < frames; i++)
+		out[i] = (float)in[i * stride] * scale;
+}
+
+static void conv_s32_to_float(float *out, const int32_t *in, size_t stride,
+		size_t frames, float volume)
+{
+	float  scale = volume / 2147483648.0f;
+	__m128 vol   = _mm_set1_ps(scale);
+	size_t i     = 0;
+
+	if (stride == 1) {
+		for (; i + 4 <= frames; i += 4) {
+			__m128i val = _mm_loadu_si128((const __m128i*)(in + i));
+			_mm_storeu_ps(out + i,
+					_mm_mul_ps(_mm_cvtepi32_ps(val), vol));
+		}
+	}
+
+	for (; i < frames; i++)
+		out[i] = (float)in[i * stride] * scale;
+}
+
+static void conv_u8_to_float(float *out, const uint8_t *in, size_t stride,
+		size_t frames, float volume)
+{
+	float scale = volume / 128.0f;
+
+	for (size_t i = 0; i < frames; i++)
+		out[i] = ((float)in[i * stride] - 128.0f) * scale;
+}
+
+void audio_format_to_float(float *out, const uint8_t *in,
+		enum audio_format format, size_t offset, size_t stride,
+		size_t frames, float volume)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		conv_u8_to_float(out, in + offset, stride, frames, volume);
+		break;
+
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		conv_s16_to_float(out, (const int16_t*)in + offset, stride,
+				frames, volume);
+		break;
+
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		conv_s32_to_float(out, (const int32_t*)in + offset, stride,
+				frames, volume);
+		break;
+
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		conv_float_to_float(out, (const float*)in + offset, stride,
+				frames, volume);
+		break;
+
+	case AUDIO_FORMAT_UNKNOWN:
+		blog(LOG_ERROR, "audio_format_to_float: Unknown format");
+		break;
+	}
+}
+
+static void conv_float_to_s16(int16_t *out, const float *in, size_t stride,
+		size_t frames)
+{
+	__m128 scale = _mm_set1_ps(32767.0f);
+	size_t i     = 0;
+
+	if (stride == 1) {
+		for (; i + 8 <= frames; i += 8) {
+			__m128i lo = _mm_cvttps_epi32(_mm_mul_ps(
+					_mm_loadu_ps(in + i), scale));
+			__m128i hi = _mm_cvttps_epi32(_mm_mul_ps(
+					_mm_loadu_ps(in + i + 4), scale));
+			_mm_storeu_si128((__m128i*)(out + i),
+					_mm_packs_epi32(lo, hi));
+		}
+	}
+
+	for (; i < frames; i++)
+		out[i * stride] = (int16_t)(in[i] * 32767.0f);
+}
+
+void audio_format_from_float(uint8_t *out_data, const float *in,
+		enum audio_format format, size_t offset, size_t stride,
+		size_t frames)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR: {
+		uint8_t *out = out_data + offset;
+		for (size_t i = 0; i < frames; i++) {
+			int32_t val = (int32_t)(in[i] * 127.0f);
+			out[i * stride] = (uint8_t)(val + 128);
+		}
+		break;
+	}
+
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		conv_float_to_s16((int16_t*)out_data + offset, in, stride,
+				frames);
+		break;
+
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR: {
+		int32_t *out = (int32_t*)out_data + offset;
+		for (size_t i = 0; i < frames; i++)
+			out[i * stride] = (int32_t)((double)in[i] *
+					2147483647.0);
+		break;
+	}
+
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR: {
+		float *out = (float*)out_data + offset;
+		if (stride == 1) {
+			memcpy(out, in, frames * sizeof(float));
+		} else {
+			for (size_t i = 0; i < frames; i++)
+				out[i * stride] = in[i];
+		}
+		break;
+	}
+
+	case AUDIO_FORMAT_UNKNOWN:
+		blog(LOG_ERROR, "audio_format_from_float: Unknown format");
+		break;
+	}
+}
+
+/* interleaved stereo is by far the most common interleaved output, so both
+ * channels are written at once for it */
+static bool interleave_stereo(uint8_t *out_data, const float *const in[],
+		enum audio_format format, size_t frames)
+{
+	size_t i = 0;
+
+	if (format == AUDIO_FORMAT_FLOAT) {
+		float *out = (float*)out_data;
+
+		for (; i + 4 <= frames; i += 4) {
+			__m128 l = _mm_loadu_ps(in[0] + i);
+			__m128 r = _mm_loadu_ps(in[1] + i);
+			_mm_storeu_ps(out + i * 2,     _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(l, r));
+		}
+
+		for (; i < frames; i++) {
+			out[i * 2]     = in[0][i];
+			out[i * 2 + 1] = in[1][i];
+		}
+
+	} else if (format == AUDIO_FORMAT_16BIT) {
+		int16_t *out  = (int16_t*)out_data;
+		__m128 scale  = _mm_set1_ps(32767.0f);
+
+		for (; i + 4 <= frames; i += 4) {
+			__m128i l = _mm_cvttps_epi32(_mm_mul_ps(
+					_mm_loadu_ps(in[0] + i), scale));
+			__m128i r = _mm_cvttps_epi32(_mm_mul_ps(
+					_mm_loadu_ps(in[1] + i), scale));
+			__m128i lr_lo = _mm_unpacklo_epi32(l, r);
+			__m128i lr_hi = _mm_unpackhi_epi32(l, r);
+			_mm_storeu_si128((__m128i*)(out + i * 2),
+					_mm_packs_epi32(lr_lo, lr_hi));
+		}
+
+		for (; i < frames; i++) {
+			out[i * 2]     = (int16_t)(in[0][i] * 32767.0f);
+			out[i * 2 + 1] = (int16_t)(in[1][i] * 32767.0f);
+		}
+
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/* converts float planar channels to an interleaved format */
+static void interleave_from_float(uint8_t *out, const float *const in[],
+		enum audio_format format, size_t channels, size_t frames)
+{
+	if (channels == 2 && interleave_stereo(out, in, format, frames))
+		return;
+
+	for (size_t i = 0; i < channels; i++)
+		audio_format_from_float(out, in[i], format, i, channels,
+				frames);
+}
+
+void audio_format_from_float_planes(uint8_t *const out[],
+		const float *const in[], enum audio_format format,
+		size_t channels, size_t frames)
+{
+	if (is_audio_planar(format)) {
+		for (size_t i = 0; i < channels; i++)
+			audio_format_from_float(out[i], in[i], format, 0, 1,
+					frames);
+	} else {
+		interleave_from_float(out[0], in, format, channels, frames);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+/* channel remixing, with the same coefficients swresample uses by default.
+ * like swresample, they're only normalized (so that a full scale input
+ * can't clip) when converting to an integer format.  float output keeps
+ * the full level, and can go out of range. */
+
+/* -3dB, used for the center and surround channels, and for mono to stereo */
+#define CENTER_MIX 0.70710678f
+
+/* scales the matrix down if any output channel could exceed full scale */
+static void normalize_matrix(float matrix[MAX_AV_PLANES][MAX_AV_PLANES])
+{
+	float max_sum = 0.0f;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		float sum = 0.0f;
+		for (size_t j = 0; j < MAX_AV_PLANES; j++)
+			sum += fabsf(matrix[i][j]);
+		if (sum > max_sum)
+			max_sum = sum;
+	}
+
+	if (max_sum <= 1.0f)
+		return;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		for (size_t j = 0; j < MAX_AV_PLANES; j++)
+			matrix[i][j] /= max_sum;
+}
+
+static bool get_remix_matrix(float matrix[MAX_AV_PLANES][MAX_AV_PLANES],
+		enum speaker_layout dst, enum speaker_layout src,
+		bool normalize)
+{
+	memset(matrix, 0, sizeof(float) * MAX_AV_PLANES * MAX_AV_PLANES);
+
+	if (src == SPEAKERS_MONO && dst == SPEAKERS_STEREO) {
+		matrix[0][0] = CENTER_MIX;
+		matrix[1][0] = CENTER_MIX;
+
+	} else if (src == SPEAKERS_STEREO && dst == SPEAKERS_MONO) {
+		matrix[0][0] = CENTER_MIX;
+		matrix[0][1] = CENTER_MIX;
+
+	} else if ((src == SPEAKERS_5POINT1 ||
+	            src == SPEAKERS_5POINT1_SURROUND) &&
+	           dst == SPEAKERS_STEREO) {
+		/* FL FR FC LFE SL SR, the LFE channel is dropped */
+		matrix[0][0] = 1.0f;
+		matrix[0][2] = CENTER_MIX;
+		matrix[0][4] = CENTER_MIX;
+		matrix[1][1] = 1.0f;
+		matrix[1][2] = CENTER_MIX;
+		matrix[1][5] = CENTER_MIX;
+
+	} else {
+		return false;
+	}
+
+	if (normalize)
+		normalize_matrix(matrix);
+	return true;
+}
+
+static void mix_scaled(float *out, const float *in, float coef,
+		size_t frames, bool add)
+{
+	__m128 coef_val = _mm_set1_ps(coef);
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 val = _mm_mul_ps(_mm_loadu_ps(in + i), coef_val);
+		if (add)
+			val = _mm_add_ps(val, _mm_loadu_ps(out + i));
+		_mm_storeu_ps(out + i, val);
+	}
+
+	for (; i < frames; i++)
+		out[i] = add ? out[i] + in[i] * coef : in[i] * coef;
+}
+
+static void clamp_samples(float *vals, size_t frames)
+{
+	__m128 min_val = _mm_set1_ps(-1.0f);
+	__m128 max_val = _mm_set1_ps(1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 val = _mm_loadu_ps(vals + i);
+		val = _mm_min_ps(_mm_max_ps(val, min_val), max_val);
+		_mm_storeu_ps(vals + i, val);
+	}
+
+	for (; i < frames; i++) {
+		if (vals[i] > 1.0f)
+			vals[i] = 1.0f;
+		else if (vals[i] < -1.0f)
+			vals[i] = -1.0f;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline bool is_float_format(enum audio_format format)
+{
+	return format == AUDIO_FORMAT_FLOAT ||
+	       format == AUDIO_FORMAT_FLOAT_PLANAR;
+}
+
+struct audio_convert {
+	struct resample_info input;
+	struct resample_info output;
+	size_t               in_channels;
+	size_t               out_channels;
+
+	bool                 remix;
+	float                matrix[MAX_AV_PLANES][MAX_AV_PLANES];
+
+	DARRAY(float)        float_buffers[MAX_AV_PLANES];
+	DARRAY(float)        remix_buffers[MAX_AV_PLANES];
+	DARRAY(uint8_t)      out_buffers[MAX_AV_PLANES];
+};
+
+bool audio_convert_supported(const struct resample_info *dst,
+		const struct resample_info *src)
+{
+	float matrix[MAX_AV_PLANES][MAX_AV_PLANES];
+
+	if (src->samples_per_sec != dst->samples_per_sec)
+		return false;
+	if (src->format == AUDIO_FORMAT_UNKNOWN ||
+	    dst->format == AUDIO_FORMAT_UNKNOWN)
+		return false;
+	if (src->speakers == SPEAKERS_UNKNOWN ||
+	    dst->speakers == SPEAKERS_UNKNOWN)
+		return false;
+
+	return src->speakers == dst->speakers ||
+		get_remix_matrix(matrix, dst->speakers, src->speakers, false);
+}
+
+audio_convert_t audio_convert_create(const struct resample_info *dst,
+		const struct resample_info *src)
+{
+	struct audio_convert *convert;
+
+	if (!audio_convert_supported(dst, src))
+		return NULL;
+
+	convert = bzalloc(sizeof(struct audio_convert));
+	convert->input        = *src;
+	convert->output       = *dst;
+	convert->in_channels  = get_audio_channels(src->speakers);
+	convert->out_channels = get_audio_channels(dst->speakers);
+	convert->remix        = src->speakers != dst->speakers;
+
+	if (convert->remix)
+		get_remix_matrix(convert->matrix, dst->speakers, src->speakers,
+				!is_float_format(dst->format));
+
+	return convert;
+}
+
+void audio_convert_destroy(audio_convert_t convert)
+{
+	if (convert) {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			da_free(convert->float_buffers[i]);
+			da_free(convert->remix_buffers[i]);
+			da_free(convert->out_buffers[i]);
+		}
+
+		bfree(convert);
+	}
+}
+
+/* converts the input to float planar, pointing straight at the input if it
+ * already is */
+static void convert_input(struct audio_convert *convert,
+		const float *in[], const uint8_t *const input[],
+		uint32_t frames)
+{
+	enum audio_format format = convert->input.format;
+	bool planar = is_audio_planar(format);
+
+	for (size_t i = 0; i < convert->in_channels; i++) {
+		if (format == AUDIO_FORMAT_FLOAT_PLANAR) {
+			in[i] = (const float*)input[i];
+			continue;
+		}
+
+		da_resize(convert->float_buffers[i], frames);
+		audio_format_to_float(convert->float_buffers[i].array,
+				input[planar ? i : 0], format,
+				planar ? 0 : i,
+				planar ? 1 : convert->in_channels,
+				frames, 1.0f);
+		in[i] = convert->float_buffers[i].array;
+	}
+}
+
+static void remix_channels(struct audio_convert *convert, const float *out[],
+		const float *const in[], uint32_t frames)
+{
+	for (size_t i = 0; i < convert->out_channels; i++) {
+		float *remix;
+		bool add = false;
+
+		da_resize(convert->remix_buffers[i], frames);
+		remix = convert->remix_buffers[i].array;
+
+		for (size_t j = 0; j < convert->in_channels; j++) {
+			float coef = convert->matrix[i][j];
+
+			if (coef != 0.0f) {
+				mix_scaled(remix, in[j], coef, frames, add);
+				add = true;
+			}
+		}
+
+		if (!add)
+			memset(remix, 0, frames * sizeof(float));
+
+		out[i] = remix;
+	}
+}
+
+static void clamp_output(struct audio_convert *convert, const float *out[],
+		uint32_t frames)
+{
+	/* float planar input that isn't remixed is used in place, so it has
+	 * to be copied before it can be clamped */
+	bool in_place = !convert->remix &&
+		convert->input.format == AUDIO_FORMAT_FLOAT_PLANAR;
+
+	for (size_t i = 0; i < convert->out_channels; i++) {
+		float *vals;
+
+		if (in_place) {
+			da_resize(convert->float_buffers[i], frames);
+			memcpy(convert->float_buffers[i].array, out[i],
+					frames * sizeof(float));
+			out[i] = convert->float_buffers[i].array;
+		}
+
+		vals = (float*)out[i];
+		clamp_samples(vals, frames);
+	}
+}
+
+bool audio_convert_process(audio_convert_t convert,
+		uint8_t *output[], const uint8_t *const input[],
+		uint32_t frames)
+{
+	enum audio_format format;
+	const float *in[MAX_AV_PLANES];
+	const float *out[MAX_AV_PLANES];
+	size_t planes, plane_size;
+
+	if (!convert) return false;
+
+	format = convert->output.format;
+	planes = is_audio_planar(format) ? convert->out_channels : 1;
+	plane_size = get_audio_size(format, convert->output.speakers, frames);
+
+	convert_input(convert, in, input, frames);
+
+	if (convert->remix) {
+		remix_channels(convert, out, in, frames);
+	} else {
+		for (size_t i = 0; i < convert->out_channels; i++)
+			out[i] = in[i];
+	}
+
+	/* float input isn't guaranteed to be in range, integer input always
+	 * is (and remixing to an integer format is normalized, so it can't
+	 * push it out of range) */
+	if (!is_float_format(format) && is_float_format(convert->input.format))
+		clamp_output(convert, out, frames);
+
+	for (size_t i = 0; i < planes; i++) {
+		da_resize(convert->out_buffers[i], plane_size);
+		output[i] = convert->out_buffers[i].array;
+	}
+
+	audio_format_from_float_planes(output, out, format,
+			convert->out_channels, frames);
+	return true;
+}
@@ -0,0 +1,83 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "audio-io.h"
+#include "audio-resampler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Functions for converting audio between sample formats and channel layouts
+ * without changing the sample rate
+ */
+
+/**
+ * Converts one channel to 32bit float, multiplying it by volume.  offset is
+ * the index of the channel's first sample, and stride the distance between
+ * its samples (the number of channels for interleaved data, 1 if planar).
+ */
+EXPORT void audio_format_to_float(float *out, const uint8_t *in,
+		enum audio_format format, size_t offset, size_t stride,
+		size_t frames, float volume);
+
+/**
+ * Converts one channel from 32bit float.  The input is expected to already
+ * be clamped to the -1.0 to 1.0 range.
+ */
+EXPORT void audio_format_from_float(uint8_t *out, const float *in,
+		enum audio_format format, size_t offset, size_t stride,
+		size_t frames);
+
+/**
+ * Converts float planar channels to any format, planar or interleaved.
+ */
+EXPORT void audio_format_from_float_planes(uint8_t *const out[],
+		const float *const in[], enum audio_format format,
+		size_t channels, size_t frames);
+
+struct audio_convert;
+typedef struct audio_convert *audio_convert_t;
+
+/**
+ * Returns whether a conversion can be done natively: the sample rates must
+ * match, and the channel layouts must either match or be one of the
+ * supported remixes (mono to stereo, stereo to mono, 5.1 to stereo).
+ * Remixes use the same levels as swresample.
+ */
+EXPORT bool audio_convert_supported(const struct resample_info *dst,
+		const struct resample_info *src);
+
+EXPORT audio_convert_t audio_convert_create(const struct resample_info *dst,
+		const struct resample_info *src);
+EXPORT void audio_convert_destroy(audio_convert_t convert);
+
+/**
+ * Converts the input, output points to internal buffers that are valid until
+ * the next call.
+ */
+EXPORT bool audio_convert_process(audio_convert_t convert,
+		uint8_t *output[], const uint8_t *const input[],
+		uint32_t frames);
+
+#ifdef __cplusplus
+}
+#endif
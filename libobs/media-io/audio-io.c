@@ -17,6 +17,8 @@
 
 #include <math.h>
 #include <inttypes.h>
+#include <xmmintrin.h>
+#include <emmintrin.h>
 
 #include "../util/threading.h"
 #include "../util/darray.h"
@@ -24,38 +26,177 @@
 #include "../util/platform.h"
 
 #include "audio-io.h"
+#include "audio-convert.h"
 #include "audio-resampler.h"
 
 /* #define DEBUG_AUDIO */
 
 #define nop() do {int invalid = 0;} while(0)
 
-struct audio_input {
-	struct audio_convert_info conversion;
+/* inputs that request identical conversions share a single converter, so
+ * each conversion is only done once per tick no matter how many inputs
+ * are connected with it */
+struct audio_converter {
+	size_t                    mix_idx;
+	struct audio_convert_info info;
 	audio_resampler_t         resampler;
+	long                      refs;
+
+	/* result of the current tick */
+	struct audio_data         data;
+	bool                      success;
+};
+
+/* number of ticks that can be queued for an input before its thread picks
+ * them up.  must be a power of two. */
+#define AUDIO_INPUT_QUEUE_SIZE 64
+
+struct audio_input_packet {
+	uint8_t                   *data[MAX_AV_PLANES];
+	size_t                    capacity;
+	uint32_t                  frames;
+	uint64_t                  timestamp;
+};
+
+/* each input is called back from its own thread, so a slow input (such as
+ * an encoder) never holds up the mixer or any of the other inputs.  the
+ * audio thread is the only writer of the queue, and the input's thread the
+ * only reader. */
+struct audio_input {
+	size_t                    mix_idx;
+
+	/* NULL if the input uses the output format */
+	struct audio_converter    *converter;
+
+	size_t                    planes;
+	size_t                    block_size;
+
+	pthread_t                 thread;
+	bool                      thread_initialized;
+	bool                      free_on_exit;
+	os_sem_t                  sem;
+	volatile long             stop;
+
+	struct audio_input_packet packets[AUDIO_INPUT_QUEUE_SIZE];
+	volatile long             packet_write;
+	volatile long             packet_read;
+	bool                      overflowing;
 
 	void (*callback)(void *param, struct audio_data *data);
 	void *param;
 };
 
-static inline void audio_input_free(struct audio_input *input)
+/* lock-free snapshot of the levels of the last tick.  the audio thread is
+ * the only writer; seq is odd while the levels are being written, and readers
+ * retry if it was odd or changed while they were copying. */
+struct audio_level_data {
+	volatile long              seq;
+	struct audio_levels        levels;
+};
+
+static void audio_levels_publish(struct audio_level_data *data,
+		const struct audio_levels *levels)
+{
+	os_atomic_inc_long(&data->seq);
+	data->levels = *levels;
+	os_atomic_inc_long(&data->seq);
+}
+
+static void audio_levels_read(struct audio_level_data *data,
+		struct audio_levels *levels)
+{
+	long seq;
+
+	do {
+		seq = os_atomic_load_long(&data->seq);
+		*levels = data->levels;
+	} while ((seq & 1) != 0 || seq != os_atomic_load_long(&data->seq));
+}
+
+/* snapshot of the stats of a line, published the same way as the levels */
+struct audio_stats_data {
+	volatile long              seq;
+	struct audio_line_stats    stats;
+};
+
+static void audio_stats_publish(struct audio_stats_data *data,
+		const struct audio_line_stats *stats)
 {
-	audio_resampler_destroy(input->resampler);
+	os_atomic_inc_long(&data->seq);
+	data->stats = *stats;
+	os_atomic_inc_long(&data->seq);
 }
 
+static void audio_stats_read(struct audio_stats_data *data,
+		struct audio_line_stats *stats)
+{
+	long seq;
+
+	do {
+		seq = os_atomic_load_long(&data->seq);
+		*stats = data->stats;
+	} while ((seq & 1) != 0 || seq != os_atomic_load_long(&data->seq));
+}
+
+/* interval at which the stats of each line are logged */
+#define AUDIO_STATS_LOG_SEC 10
+
+/* number of packets that can be queued on a line before the audio thread
+ * picks them up.  must be a power of two. */
+#define AUDIO_LINE_QUEUE_SIZE 256
+
+/* float planar audio packet, owned by the producer until it's queued */
+struct audio_line_packet {
+	float                      *data[MAX_AV_PLANES];
+	uint32_t                   capacity;
+	uint32_t                   frames;
+	uint64_t                   timestamp;
+};
+
 struct audio_line {
 	char                       *name;
 
 	struct audio_output        *audio;
+
+	/* single producer/single consumer queue.  audio_line_output only ever
+	 * writes packet_write, and the audio thread only ever writes
+	 * packet_read, so neither side can block the other. */
+	struct audio_line_packet   packets[AUDIO_LINE_QUEUE_SIZE];
+	volatile long              packet_write;
+	volatile long              packet_read;
+	volatile long              dropped_packets;
+	bool                       overflowing;
+
+	/* only accessed by the audio thread */
 	struct circlebuf           buffers[MAX_AV_PLANES];
-	pthread_mutex_t            mutex;
-	DARRAY(uint8_t)            volume_buffers[MAX_AV_PLANES];
 	uint64_t                   base_timestamp;
-	uint64_t                   last_timestamp;
+
+	/* clock drift compensation, only accessed by the audio thread (except
+	 * for drift_ppm) */
+	uint64_t                   next_packet_ts;
+	DARRAY(float)              resample_buffers[MAX_AV_PLANES];
+	float                      last_samples[MAX_AV_PLANES];
+	double                     resample_pos;
+	double                     drift_ratio;
+	double                     fill_avg;
+	double                     fill_target;
+	uint64_t                   settle_frames;
+	volatile long              drift_ppm;
+
+	struct audio_level_data    levels;
+
+	/* stats are counted by the audio thread in stats, and published to
+	 * stats_data once per tick (dropped_packets is counted separately by
+	 * the producer) */
+	struct audio_line_stats    stats;
+	struct audio_stats_data    stats_data;
+
+	/* mask of the mixes the line is mixed in to */
+	volatile long              mixers;
 
 	/* states whether this line is still being used.  if not, then when the
-	 * buffer is depleted, it's destroyed */
-	bool                       alive;
+	 * buffer is depleted, it's destroyed by the audio thread */
+	volatile long              alive;
 
 	struct audio_line          **prev_next;
 	struct audio_line          *next;
@@ -65,24 +206,37 @@ static inline void audio_line_destroy_data(struct audio_line *line)
 {
 	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
 		circlebuf_free(&line->buffers[i]);
-		da_free(line->volume_buffers[i]);
+		da_free(line->resample_buffers[i]);
 	}
+	for (size_t i = 0; i < AUDIO_LINE_QUEUE_SIZE; i++)
+		bfree(line->packets[i].data[0]);
 
-	pthread_mutex_destroy(&line->mutex);
 	bfree(line->name);
 	bfree(line);
 }
 
+struct audio_mix {
+	DARRAY(uint8_t)            mix_buffers[MAX_AV_PLANES];
+	DARRAY(uint8_t)            out_buffers[MAX_AV_PLANES];
+	struct audio_level_data    levels;
+};
+
 struct audio_output {
 	struct audio_output_info   info;
 	size_t                     block_size;
 	size_t                     channels;
 	size_t                     planes;
+	uint64_t                   tick_time;
+	uint64_t                   last_stats_log;
 
 	pthread_t                  thread;
 	os_event_t                 stop_event;
 
-	DARRAY(uint8_t)            mix_buffers[MAX_AV_PLANES];
+	struct audio_mix           mixes[MAX_AUDIO_MIXES];
+
+	/* mask of the mixes that have inputs connected.  the first mix is
+	 * always mixed so that the master levels are available. */
+	volatile long              active_mixes;
 
 	bool                       initialized;
 
@@ -90,7 +244,8 @@ struct audio_output {
 	struct audio_line          *first_line;
 
 	pthread_mutex_t            input_mutex;
-	DARRAY(struct audio_input) inputs;
+	DARRAY(struct audio_input*) inputs;
+	DARRAY(struct audio_converter*) converters;
 };
 
 static inline void audio_output_removeline(struct audio_output *audio,
@@ -130,9 +285,10 @@ static size_t ts_diff_frames(audio_t audio, uint64_t ts1, uint64_t ts2)
 	return (size_t)positive_round(diff);
 }
 
+/* line and mix buffers are always float planar */
 static size_t ts_diff_bytes(audio_t audio, uint64_t ts1, uint64_t ts2)
 {
-	return ts_diff_frames(audio, ts1, ts2) * audio->block_size;
+	return ts_diff_frames(audio, ts1, ts2) * sizeof(float);
 }
 
 /* unless the value is 3+ hours worth of frames, this won't overflow */
@@ -158,7 +314,10 @@ static inline void clear_excess_audio_data(struct audio_line *line,
 	                line->name, (uint32_t)size,
 	                prev_time, line->base_timestamp);*/
 
-	for (size_t i = 0; i < line->audio->planes; i++) {
+	line->stats.excess_frames += ((size < line->buffers[0].size) ?
+			size : line->buffers[0].size) / sizeof(float);
+
+	for (size_t i = 0; i < line->audio->channels; i++) {
 		size_t clear_size = (size < line->buffers[i].size) ?
 			size : line->buffers[i].size;
 
@@ -176,130 +335,147 @@ static inline size_t min_size(size_t a, size_t b)
 	return a < b ? a : b;
 }
 
+static inline double min_double(double a, double b)
+{
+	return a < b ? a : b;
+}
+
 #ifndef CLAMP
 #define CLAMP(val, minval, maxval) \
 	((val > maxval) ? maxval : ((val < minval) ? minval : val))
 #endif
 
-#define MIN_S8  -128
-#define MAX_S8   127
-#define MIN_S16 -32767
-#define MAX_S16  32767
-#define MIN_S32 -2147483647
-#define MAX_S32  2147483647
+/* ------------------------------------------------------------------------- */
+/* all mixing is done internally in 32bit float planar regardless of the
+ * output format.  data is converted to float once when it's placed in to an
+ * audio line (with the volume applied as part of the conversion), and
+ * converted to the output format once per tick.  the conversions themselves
+ * are in audio-convert.c. */
 
-#define MIX_BUFFER_SIZE 256
+/* ------------------------------------------------------------------------- */
 
-/* TODO: optimize mixing */
-static void mix_u8(uint8_t *mix, struct circlebuf *buf, size_t size)
+/* the mix buffer is not guaranteed to be aligned (the mix offset is based
+ * upon timestamps, and the circular buffer segments can start anywhere), so
+ * unaligned loads/stores are used.  the sum is not clamped here; the whole
+ * mix is clamped once after all lines have been mixed. */
+static inline void add_levels(__m128 peak_val, __m128 sum_val,
+		float *peak, float *sum_sq)
 {
-	uint8_t  vals[MIX_BUFFER_SIZE];
-	register int16_t mix_val;
+	float peaks[4];
+	float sums[4];
 
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+	_mm_storeu_ps(peaks, peak_val);
+	_mm_storeu_ps(sums, sum_val);
 
-		circlebuf_pop_front(buf, vals, pop_count);
-
-		for (size_t i = 0; i < pop_count; i++) {
-			mix_val =  (int16_t)*mix - 128;
-			mix_val += (int16_t)vals[i] - 128;
-			mix_val = CLAMP(mix_val, MIN_S8, MAX_S8) + 128;
-			*(mix++) = (uint8_t)mix_val;
-		}
+	for (size_t i = 0; i < 4; i++) {
+		if (peaks[i] > *peak)
+			*peak = peaks[i];
+		*sum_sq += sums[i];
 	}
 }
 
-static void mix_s16(uint8_t *mix_in, struct circlebuf *buf, size_t size)
+/* levels are measured while mixing so that metering doesn't require another
+ * pass over the data.  peak is the maximum absolute sample value, sum_sq is
+ * the sum of the squared samples.
+ *
+ * the values are added to every mix the line is routed to while they're
+ * loaded, so each line is only read once no matter how many mixes there
+ * are. */
+static void mix_float(float *const *mixes, size_t mix_count,
+		const float *vals, size_t frames, float *peak, float *sum_sq)
 {
-	int16_t *mix = (int16_t*)mix_in;
-	int16_t vals[MIX_BUFFER_SIZE];
-	register int32_t mix_val;
-
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 peak_val = _mm_setzero_ps();
+	__m128 sum_val  = _mm_setzero_ps();
+	size_t i = 0;
 
-		circlebuf_pop_front(buf, vals, pop_count);
-		pop_count /= sizeof(int16_t);
+	for (; i + 4 <= frames; i += 4) {
+		__m128 b = _mm_loadu_ps(vals + i);
 
-		for (size_t i = 0; i < pop_count; i++) {
-			mix_val =  (int32_t)*mix;
-			mix_val += (int32_t)vals[i];
-			*(mix++) = (int16_t)CLAMP(mix_val, MIN_S16, MAX_S16);
+		for (size_t mix = 0; mix < mix_count; mix++) {
+			__m128 a = _mm_loadu_ps(mixes[mix] + i);
+			_mm_storeu_ps(mixes[mix] + i, _mm_add_ps(a, b));
 		}
+
+		peak_val = _mm_max_ps(peak_val, _mm_and_ps(b, abs_mask));
+		sum_val  = _mm_add_ps(sum_val, _mm_mul_ps(b, b));
 	}
-}
 
-static void mix_s32(uint8_t *mix_in, struct circlebuf *buf, size_t size)
-{
-	int32_t *mix = (int32_t*)mix_in;
-	int32_t vals[MIX_BUFFER_SIZE];
-	register int64_t mix_val;
+	add_levels(peak_val, sum_val, peak, sum_sq);
 
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+	for (; i < frames; i++) {
+		float val = vals[i];
 
-		circlebuf_pop_front(buf, vals, pop_count);
-		pop_count /= sizeof(int32_t);
+		for (size_t mix = 0; mix < mix_count; mix++)
+			mixes[mix][i] += val;
 
-		for (size_t i = 0; i < pop_count; i++) {
-			mix_val =  (int64_t)*mix;
-			mix_val += (int64_t)vals[i];
-			*(mix++) = (int32_t)CLAMP(mix_val, MIN_S32, MAX_S32);
-		}
+		if (fabsf(val) > *peak)
+			*peak = fabsf(val);
+		*sum_sq += val * val;
 	}
 }
 
-static void mix_float(uint8_t *mix_in, struct circlebuf *buf, size_t size)
+static void clamp_float(float *vals, size_t frames, float *peak,
+		float *sum_sq)
 {
-	float *mix = (float*)mix_in;
-	float vals[MIX_BUFFER_SIZE];
-	register float mix_val;
+	__m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+	__m128 min_val  = _mm_set1_ps(-1.0f);
+	__m128 max_val  = _mm_set1_ps(1.0f);
+	__m128 peak_val = _mm_setzero_ps();
+	__m128 sum_val  = _mm_setzero_ps();
+	size_t i = 0;
+
+	for (; i + 4 <= frames; i += 4) {
+		__m128 val = _mm_loadu_ps(vals + i);
+		val = _mm_min_ps(_mm_max_ps(val, min_val), max_val);
+		_mm_storeu_ps(vals + i, val);
+
+		peak_val = _mm_max_ps(peak_val, _mm_and_ps(val, abs_mask));
+		sum_val  = _mm_add_ps(sum_val, _mm_mul_ps(val, val));
+	}
 
-	while (size) {
-		size_t pop_count = min_size(size, sizeof(vals));
-		size -= pop_count;
+	add_levels(peak_val, sum_val, peak, sum_sq);
 
-		circlebuf_pop_front(buf, vals, pop_count);
-		pop_count /= sizeof(float);
+	for (; i < frames; i++) {
+		float val = CLAMP(vals[i], -1.0f, 1.0f);
+		vals[i] = val;
 
-		for (size_t i = 0; i < pop_count; i++) {
-			mix_val =  *mix + vals[i];
-			*(mix++) = CLAMP(mix_val, -1.0f, 1.0f);
-		}
+		if (fabsf(val) > *peak)
+			*peak = fabsf(val);
+		*sum_sq += val * val;
 	}
 }
 
-static inline void mix_audio(enum audio_format format,
-		uint8_t *mix, struct circlebuf *buf, size_t size)
+/* mixes straight out of the (up to two) contiguous segments of the circular
+ * buffer instead of popping the data in to a temporary array first */
+static void mix_audio(float **mixes, size_t mix_count, struct circlebuf *buf,
+		size_t size, float *peak, float *sum_sq)
 {
-	switch (format) {
-	case AUDIO_FORMAT_UNKNOWN:
-		break;
+	uint8_t *data = buf->data;
+	size_t start_size;
 
-	case AUDIO_FORMAT_U8BIT:
-	case AUDIO_FORMAT_U8BIT_PLANAR:
-		mix_u8(mix, buf, size); break;
+	if (!size)
+		return;
 
-	case AUDIO_FORMAT_16BIT:
-	case AUDIO_FORMAT_16BIT_PLANAR:
-		mix_s16(mix, buf, size); break;
+	start_size = min_size(size, buf->capacity - buf->start_pos);
+	mix_float(mixes, mix_count, (const float*)(data + buf->start_pos),
+			start_size / sizeof(float), peak, sum_sq);
 
-	case AUDIO_FORMAT_32BIT:
-	case AUDIO_FORMAT_32BIT_PLANAR:
-		mix_s32(mix, buf, size); break;
+	if (size > start_size) {
+		for (size_t mix = 0; mix < mix_count; mix++)
+			mixes[mix] += start_size / sizeof(float);
 
-	case AUDIO_FORMAT_FLOAT:
-	case AUDIO_FORMAT_FLOAT_PLANAR:
-		mix_float(mix, buf, size); break;
+		mix_float(mixes, mix_count, (const float*)data,
+				(size - start_size) / sizeof(float),
+				peak, sum_sq);
 	}
+
+	circlebuf_pop_front(buf, NULL, size);
 }
 
 static inline bool mix_audio_line(struct audio_output *audio,
-		struct audio_line *line, size_t size, uint64_t timestamp)
+		struct audio_line *line, uint32_t mixers, size_t size,
+		uint64_t timestamp, struct audio_levels *levels)
 {
 	size_t time_offset = ts_diff_bytes(audio,
 			line->base_timestamp, timestamp);
@@ -312,72 +488,492 @@ static inline bool mix_audio_line(struct audio_output *audio,
 	blog(LOG_DEBUG, "shaved off %lu bytes", size);
 #endif
 
-	for (size_t i = 0; i < audio->planes; i++) {
+	if (line->buffers[0].size && line->buffers[0].size < size)
+		line->stats.underruns++;
+
+	for (size_t i = 0; i < audio->channels; i++) {
 		size_t pop_size = min_size(size, line->buffers[i].size);
+		float *mixes[MAX_AUDIO_MIXES];
+		size_t mix_count = 0;
+
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			struct audio_mix *audio_mix = audio->mixes + mix;
+
+			if ((mixers & (1 << mix)) != 0)
+				mixes[mix_count++] = (float*)(time_offset +
+					audio_mix->mix_buffers[i].array);
+		}
 
-		mix_audio(audio->info.format,
-				audio->mix_buffers[i].array + time_offset,
-				&line->buffers[i], pop_size);
+		mix_audio(mixes, mix_count, &line->buffers[i], pop_size,
+				&levels->peak[i], &levels->rms[i]);
 	}
 
 	return true;
 }
 
-static bool resample_audio_output(struct audio_input *input,
-		struct audio_data *data)
+/* resamplers convert straight from the float mix */
+static void resample_audio_output(struct audio_converter *converter,
+		const struct audio_data *mix_data)
 {
-	bool success = true;
+	struct audio_data *data = &converter->data;
+	uint8_t  *output[MAX_AV_PLANES];
+	uint32_t frames;
+	uint64_t offset;
+
+	memset(output, 0, sizeof(output));
+	*data = *mix_data;
 
-	if (input->resampler) {
-		uint8_t  *output[MAX_AV_PLANES];
-		uint32_t frames;
-		uint64_t offset;
+	converter->success = audio_resampler_resample(converter->resampler,
+			output, &frames, &offset,
+			(const uint8_t *const *)mix_data->data,
+			mix_data->frames);
 
-		memset(output, 0, sizeof(output));
+	for (size_t i = 0; i < MAX_AV_PLANES; i++)
+		data->data[i] = output[i];
+	data->frames     = frames;
+	data->timestamp -= offset;
+}
+
+/* converts the float planar mix to the output format */
+static void convert_audio_output(struct audio_output *audio,
+		struct audio_mix *mix, struct audio_data *data, uint32_t frames)
+{
+	enum audio_format format = audio->info.format;
+	const float *in[MAX_AV_PLANES];
+
+	if (format == AUDIO_FORMAT_FLOAT_PLANAR)
+		return;
 
-		success = audio_resampler_resample(input->resampler,
-				output, &frames, &offset,
-				(const uint8_t *const *)data->data,
-				data->frames);
+	memset(data->data, 0, sizeof(data->data));
 
-		for (size_t i = 0; i < MAX_AV_PLANES; i++)
-			data->data[i] = output[i];
-		data->frames     = frames;
-		data->timestamp -= offset;
+	for (size_t i = 0; i < audio->planes; i++) {
+		da_resize(mix->out_buffers[i], frames * audio->block_size);
+		data->data[i] = mix->out_buffers[i].array;
 	}
 
-	return success;
+	for (size_t i = 0; i < audio->channels; i++)
+		in[i] = (const float*)mix->mix_buffers[i].array;
+
+	audio_format_from_float_planes(data->data, in, format,
+			audio->channels, frames);
+}
+
+static void audio_input_packet_reserve(struct audio_input *input,
+		struct audio_input_packet *packet, uint32_t frames)
+{
+	size_t plane_size = frames * input->block_size;
+
+	if (packet->capacity >= frames)
+		return;
+
+	bfree(packet->data[0]);
+	packet->data[0] = bmalloc(plane_size * input->planes);
+	for (size_t i = 1; i < input->planes; i++)
+		packet->data[i] = packet->data[0] + plane_size * i;
+
+	packet->capacity = frames;
+}
+
+/* copies the data in to the input's queue and wakes up its thread */
+static void audio_input_push(struct audio_input *input,
+		const struct audio_data *data)
+{
+	struct audio_input_packet *packet;
+	long write = input->packet_write;
+	long next  = (write + 1) & (AUDIO_INPUT_QUEUE_SIZE - 1);
+
+	if (next == os_atomic_load_long(&input->packet_read)) {
+		if (!input->overflowing)
+			blog(LOG_WARNING, "Audio input is not keeping up, "
+			                  "dropping audio data");
+		input->overflowing = true;
+		return;
+	}
+
+	input->overflowing = false;
+
+	packet = input->packets + write;
+	audio_input_packet_reserve(input, packet, data->frames);
+
+	for (size_t i = 0; i < input->planes; i++)
+		memcpy(packet->data[i], data->data[i],
+				data->frames * input->block_size);
+
+	packet->frames    = data->frames;
+	packet->timestamp = data->timestamp;
+
+	os_atomic_set_long(&input->packet_write, next);
+	os_sem_post(input->sem);
+}
+
+static void audio_input_destroy_data(struct audio_input *input)
+{
+	for (size_t i = 0; i < AUDIO_INPUT_QUEUE_SIZE; i++)
+		bfree(input->packets[i].data[0]);
+
+	os_sem_destroy(input->sem);
+	bfree(input);
+}
+
+static void *audio_input_thread(void *param)
+{
+	struct audio_input *input = param;
+
+	while (os_sem_wait(input->sem) == 0) {
+		long read  = input->packet_read;
+		long write = os_atomic_load_long(&input->packet_write);
+
+		if (os_atomic_load_long(&input->stop))
+			break;
+
+		while (read != write) {
+			struct audio_input_packet *packet = input->packets+read;
+			struct audio_data data;
+
+			memset(&data, 0, sizeof(data));
+			for (size_t i = 0; i < input->planes; i++)
+				data.data[i] = packet->data[i];
+			data.frames    = packet->frames;
+			data.timestamp = packet->timestamp;
+			data.volume    = 1.0f;
+
+			input->callback(input->param, &data);
+
+			/* the callback may have disconnected the input */
+			if (os_atomic_load_long(&input->stop))
+				break;
+
+			read = (read + 1) & (AUDIO_INPUT_QUEUE_SIZE - 1);
+			os_atomic_set_long(&input->packet_read, read);
+		}
+
+		if (os_atomic_load_long(&input->stop))
+			break;
+	}
+
+	if (input->free_on_exit)
+		audio_input_destroy_data(input);
+
+	return NULL;
 }
 
 static inline void do_audio_output(struct audio_output *audio,
-		uint64_t timestamp, uint32_t frames)
+		uint32_t mixers, uint64_t timestamp, uint32_t frames)
 {
-	struct audio_data data;
-	for (size_t i = 0; i < MAX_AV_PLANES; i++)
-		data.data[i] = audio->mix_buffers[i].array;
-	data.frames = frames;
-	data.timestamp = timestamp;
-	data.volume = 1.0f;
+	struct audio_data mix_data[MAX_AUDIO_MIXES];
+	struct audio_data out_data[MAX_AUDIO_MIXES];
+	bool converted[MAX_AUDIO_MIXES];
+
+	memset(mix_data, 0, sizeof(mix_data));
+	memset(converted, 0, sizeof(converted));
+
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		struct audio_mix *audio_mix = audio->mixes + mix;
+
+		for (size_t i = 0; i < audio->channels; i++)
+			mix_data[mix].data[i] =
+				audio_mix->mix_buffers[i].array;
+		mix_data[mix].frames = frames;
+		mix_data[mix].timestamp = timestamp;
+		mix_data[mix].volume = 1.0f;
+
+		out_data[mix] = mix_data[mix];
+	}
 
 	pthread_mutex_lock(&audio->input_mutex);
 
+	for (size_t i = 0; i < audio->converters.num; i++) {
+		struct audio_converter *converter = audio->converters.array[i];
+
+		if ((mixers & (1 << converter->mix_idx)) != 0)
+			resample_audio_output(converter,
+					&mix_data[converter->mix_idx]);
+		else
+			converter->success = false;
+	}
+
 	for (size_t i = 0; i < audio->inputs.num; i++) {
-		struct audio_input *input = audio->inputs.array+i;
+		struct audio_input *input = audio->inputs.array[i];
+		size_t mix = input->mix_idx;
+		struct audio_data data;
+
+		/* the mix may have been connected to after it was mixed */
+		if ((mixers & (1 << mix)) == 0)
+			continue;
+
+		/* inputs without a converter get the mix converted to the
+		 * output format, which is done only once per mix */
+		if (input->converter) {
+			if (!input->converter->success)
+				continue;
 
-		if (resample_audio_output(input, &data))
-			input->callback(input->param, &data);
+			data = input->converter->data;
+		} else {
+			if (!converted[mix]) {
+				convert_audio_output(audio, audio->mixes + mix,
+						&out_data[mix], frames);
+				converted[mix] = true;
+			}
+
+			data = out_data[mix];
+		}
+
+		audio_input_push(input, &data);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
+/* ------------------------------------------------------------------------- */
+/* clock drift compensation.  the clock of a capture device never runs at
+ * exactly the same rate as the system clock, so continuous data on a line is
+ * slowly resampled to keep the amount of buffered data at the level it
+ * settled at, rather than letting it grow (latency) or shrink (gaps) over
+ * time. */
+
+/* maximum amount of drift that will be corrected */
+#define MAX_DRIFT_PPM             1000.0
+/* time over which an error in the buffered amount is corrected */
+#define DRIFT_CORRECTION_SEC      10.0
+/* time constant of the buffered amount average */
+#define DRIFT_SMOOTHING_SEC       2.0
+/* time to let the buffered amount settle before it's used as the target */
+#define DRIFT_SETTLE_SEC          5
+/* packets within this distance of where the previous packet ended are
+ * considered continuous (sources smooth timestamps up to 70ms) */
+#define DRIFT_CONTINUITY_NS       100000000ULL
+
+static inline bool packet_continuous(struct audio_line *line,
+		const struct audio_line_packet *packet)
+{
+	uint64_t diff;
+
+	if (!line->buffers[0].size)
+		return false;
+
+	diff = (packet->timestamp > line->next_packet_ts) ?
+		packet->timestamp - line->next_packet_ts :
+		line->next_packet_ts - packet->timestamp;
+	return diff < DRIFT_CONTINUITY_NS;
+}
+
+/* restarts measurement of the buffered amount.  the drift ratio itself is
+ * kept, as the clock of the device hasn't changed. */
+static inline void reset_drift_compensation(struct audio_line *line)
+{
+	line->resample_pos  = 0.0;
+	line->fill_target   = 0.0;
+	line->settle_frames = 0;
+	if (line->drift_ratio == 0.0)
+		line->drift_ratio = 1.0;
+}
+
+/* linear interpolation; the ratio is always within a fraction of a percent
+ * of 1.0, so this is more than enough */
+static size_t resample_drift(struct audio_line *line,
+		const struct audio_line_packet *packet)
+{
+	size_t frames   = packet->frames;
+	double step     = line->drift_ratio;
+	size_t max_out  = (size_t)((double)frames / step) + 2;
+	size_t out_frames = 0;
+	double pos      = line->resample_pos;
+
+	for (size_t ch = 0; ch < line->audio->channels; ch++) {
+		const float *in = packet->data[ch];
+		float *out;
+
+		da_resize(line->resample_buffers[ch], max_out);
+		out = line->resample_buffers[ch].array;
+
+		pos = line->resample_pos;
+		out_frames = 0;
+
+		while (pos < (double)(frames - 1)) {
+			long  idx  = (long)floor(pos);
+			float frac = (float)(pos - (double)idx);
+			float a    = idx < 0 ? line->last_samples[ch] : in[idx];
+			float b    = in[idx + 1];
+
+			out[out_frames++] = a + (b - a) * frac;
+			pos += step;
+		}
+
+		line->last_samples[ch] = in[frames - 1];
+	}
+
+	line->resample_pos = pos - (double)frames;
+	return out_frames;
+}
+
+/* appends continuous data to the end of the line's buffers */
+static void audio_line_append_packet(struct audio_line *line,
+		const struct audio_line_packet *packet)
+{
+	size_t pos    = line->buffers[0].size;
+	size_t frames = resample_drift(line, packet);
+	size_t size   = frames * sizeof(float);
+
+	for (size_t i = 0; i < line->audio->channels; i++)
+		circlebuf_place(&line->buffers[i], pos,
+				line->resample_buffers[i].array, size);
+}
+
+/* called after each mix with the number of frames that were mixed */
+static void audio_line_update_drift(struct audio_line *line, uint32_t frames)
+{
+	uint32_t rate = line->audio->info.samples_per_sec;
+	double fill = (double)(line->buffers[0].size / sizeof(float));
+	double alpha = (double)frames / ((double)rate * DRIFT_SMOOTHING_SEC);
+	double ppm;
+
+	if (!line->buffers[0].size)
+		return;
+
+	if (!line->settle_frames)
+		line->fill_avg = fill;
+	else
+		line->fill_avg += (fill - line->fill_avg) * min_double(alpha, 1.0);
+
+	line->settle_frames += frames;
+	if (line->settle_frames < (uint64_t)rate * DRIFT_SETTLE_SEC)
+		return;
+
+	if (line->fill_target == 0.0)
+		line->fill_target = line->fill_avg;
+
+	/* a positive value means the device clock is running fast */
+	ppm = (line->fill_avg - line->fill_target) * 1000000.0 /
+		((double)rate * DRIFT_CORRECTION_SEC);
+	ppm = CLAMP(ppm, -MAX_DRIFT_PPM, MAX_DRIFT_PPM);
+
+	line->drift_ratio = 1.0 + ppm / 1000000.0;
+	os_atomic_set_long(&line->drift_ppm, (long)ppm);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void audio_line_place_packet(struct audio_line *line,
+		const struct audio_line_packet *packet)
+{
+	size_t pos  = ts_diff_bytes(line->audio, packet->timestamp,
+			line->base_timestamp);
+	size_t size = packet->frames * sizeof(float);
+
+#ifdef DEBUG_AUDIO
+	blog(LOG_DEBUG, "packet->timestamp: %llu, line->base_timestamp: %llu, "
+			"pos: %lu, bytes: %lu, buf size: %lu",
+			packet->timestamp, line->base_timestamp, pos,
+			size, line->buffers[0].size);
+#endif
+
+	for (size_t i = 0; i < line->audio->channels; i++)
+		circlebuf_place(&line->buffers[i], pos, packet->data[i], size);
+}
+
+static void audio_line_receive_packet(struct audio_line *line,
+		const struct audio_line_packet *packet)
+{
+	bool continuous = packet_continuous(line, packet);
+
+	line->next_packet_ts = packet->timestamp +
+		conv_frames_to_time(line->audio, packet->frames);
+	line->stats.received_packets++;
+
+	if (!packet->frames)
+		return;
+
+	if (continuous) {
+		audio_line_append_packet(line, packet);
+		return;
+	}
+
+	/* TODO: prevent insertation of data too far away from expected
+	 * audio timing */
+
+	reset_drift_compensation(line);
+	for (size_t i = 0; i < line->audio->channels; i++)
+		line->last_samples[i] = packet->data[i][packet->frames - 1];
+
+	if (!line->buffers[0].size) {
+		line->base_timestamp = packet->timestamp -
+		                       line->audio->info.buffer_ms * 1000000;
+		audio_line_place_packet(line, packet);
+
+	} else if (line->base_timestamp <= packet->timestamp) {
+		audio_line_place_packet(line, packet);
+
+	} else {
+		line->stats.bad_timestamps++;
+		blog(LOG_DEBUG, "Bad timestamp for audio line '%s', "
+		                "packet->timestamp: %"PRIu64", "
+		                "line->base_timestamp: %"PRIu64".  This can "
+		                "sometimes happen when there's a pause in "
+		                "the threads.", line->name, packet->timestamp,
+		                line->base_timestamp);
+	}
+}
+
+/* moves everything queued by audio_line_output in to the line's buffers */
+static void audio_line_receive(struct audio_line *line)
+{
+	long read  = line->packet_read;
+	long write = os_atomic_load_long(&line->packet_write);
+
+	while (read != write) {
+		audio_line_receive_packet(line, line->packets + read);
+
+		read = (read + 1) & (AUDIO_LINE_QUEUE_SIZE - 1);
+		os_atomic_set_long(&line->packet_read, read);
+	}
+}
+
+static void audio_line_update_stats(struct audio_line *line,
+		int64_t timestamp_offset)
+{
+	line->stats.buffered_frames  = line->buffers[0].size / sizeof(float);
+	line->stats.timestamp_offset = timestamp_offset;
+	line->stats.drift_ppm        = os_atomic_load_long(&line->drift_ppm);
+
+	audio_stats_publish(&line->stats_data, &line->stats);
+}
+
+static void audio_line_log_stats(struct audio_line *line)
+{
+	struct audio_line_stats stats;
+	audio_line_get_stats(line, &stats);
+
+	blog(LOG_DEBUG, "Audio line '%s': buffered: %"PRIu64" frames, "
+	                "offset: %"PRId64" ms, received: %"PRIu64", "
+	                "dropped: %"PRIu64", bad timestamps: %"PRIu64", "
+	                "excess: %"PRIu64" frames, underruns: %"PRIu64", "
+	                "drift: %ld ppm",
+	                line->name, stats.buffered_frames,
+	                stats.timestamp_offset / 1000000,
+	                stats.received_packets, stats.dropped_packets,
+	                stats.bad_timestamps, stats.excess_frames,
+	                stats.underruns, stats.drift_ppm);
+}
+
+/* converts the accumulated sums of squares to RMS values */
+static inline void finish_levels(struct audio_levels *levels, size_t channels,
+		uint32_t frames)
+{
+	for (size_t i = 0; i < channels; i++)
+		levels->rms[i] = frames ?
+			sqrtf(levels->rms[i] / (float)frames) : 0.0f;
+}
+
 static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 		uint64_t prev_time)
 {
-	struct audio_line *line = audio->first_line;
+	struct audio_line *line;
+	struct audio_levels levels;
 	uint32_t frames = (uint32_t)ts_diff_frames(audio, audio_time,
 	                                           prev_time);
-	size_t bytes = frames * audio->block_size;
+	size_t bytes = frames * sizeof(float);
+	uint32_t active_mixes;
+	bool log_stats = false;
 
 #ifdef DEBUG_AUDIO
 	blog(LOG_DEBUG, "audio_time: %llu, prev_time: %llu, bytes: %lu",
@@ -388,66 +984,128 @@ static uint64_t mix_and_output(struct audio_output *audio, uint64_t audio_time,
 	 * of data that was sampled to ensure seamless transmission */
 	audio_time = prev_time + conv_frames_to_time(audio, frames);
 
+	if (prev_time - audio->last_stats_log >=
+			AUDIO_STATS_LOG_SEC * 1000000000ULL) {
+		audio->last_stats_log = prev_time;
+		log_stats = true;
+	}
+
+	/* only mixes that are used are mixed */
+	active_mixes = (uint32_t)os_atomic_load_long(&audio->active_mixes) | 1;
+
 	/* resize and clear mix buffers */
-	for (size_t i = 0; i < audio->planes; i++) {
-		da_resize(audio->mix_buffers[i], bytes);
-		memset(audio->mix_buffers[i].array, 0, bytes);
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		struct audio_mix *audio_mix = audio->mixes + mix;
+
+		if ((active_mixes & (1 << mix)) == 0)
+			continue;
+
+		for (size_t i = 0; i < audio->channels; i++) {
+			da_resize(audio_mix->mix_buffers[i], bytes);
+			memset(audio_mix->mix_buffers[i].array, 0, bytes);
+		}
 	}
 
+	/* lines are only ever removed by this thread, and new lines are only
+	 * inserted at the front, so the list only needs to be locked to get
+	 * the first line and to unlink lines */
+	pthread_mutex_lock(&audio->line_mutex);
+	line = audio->first_line;
+	pthread_mutex_unlock(&audio->line_mutex);
+
 	/* mix audio lines */
 	while (line) {
 		struct audio_line *next = line->next;
+		bool alive = os_atomic_load_long(&line->alive) != 0;
+		int64_t timestamp_offset = 0;
+		uint32_t mixers;
+
+		audio_line_receive(line);
 
 		/* if line marked for removal, destroy and move to the next */
-		if (!line->buffers[0].size) {
-			if (!line->alive) {
-				audio_output_removeline(audio, line);
-				line = next;
-				continue;
-			}
+		if (!line->buffers[0].size && !alive) {
+			audio_output_removeline(audio, line);
+			line = next;
+			continue;
 		}
 
-		pthread_mutex_lock(&line->mutex);
+		if (line->buffers[0].size)
+			timestamp_offset =
+				(int64_t)(line->base_timestamp - prev_time);
 
 		if (line->buffers[0].size && line->base_timestamp < prev_time) {
 			clear_excess_audio_data(line, prev_time);
 			line->base_timestamp = prev_time;
 		}
 
-		if (mix_audio_line(audio, line, bytes, prev_time))
+		memset(&levels, 0, sizeof(levels));
+
+		mixers = (uint32_t)os_atomic_load_long(&line->mixers) &
+			active_mixes;
+
+		if (mix_audio_line(audio, line, mixers, bytes, prev_time,
+					&levels))
 			line->base_timestamp = audio_time;
 
-		pthread_mutex_unlock(&line->mutex);
+		finish_levels(&levels, audio->channels, frames);
+		audio_levels_publish(&line->levels, &levels);
+
+		audio_line_update_drift(line, frames);
+		audio_line_update_stats(line, timestamp_offset);
+
+		if (log_stats)
+			audio_line_log_stats(line);
 
 		line = next;
 	}
 
+	/* clamp once, after all lines have been mixed */
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		struct audio_mix *audio_mix = audio->mixes + mix;
+
+		if ((active_mixes & (1 << mix)) == 0)
+			continue;
+
+		memset(&levels, 0, sizeof(levels));
+
+		for (size_t i = 0; i < audio->channels; i++)
+			clamp_float((float*)audio_mix->mix_buffers[i].array,
+					frames, &levels.peak[i],
+					&levels.rms[i]);
+
+		finish_levels(&levels, audio->channels, frames);
+		audio_levels_publish(&audio_mix->levels, &levels);
+	}
+
 	/* output */
-	do_audio_output(audio, prev_time, frames);
+	do_audio_output(audio, active_mixes, prev_time, frames);
 
 	return audio_time;
 }
 
-/* sample audio 40 times a second */
-#define AUDIO_WAIT_TIME (1000/40)
+/* by default, sample audio 40 times a second */
+#define DEFAULT_TICKS_PER_SEC 40
 
 static void *audio_thread(void *param)
 {
 	struct audio_output *audio = param;
 	uint64_t buffer_time = audio->info.buffer_ms * 1000000;
-	uint64_t prev_time = os_gettime_ns() - buffer_time;
+	uint64_t tick_time = os_gettime_ns();
+	uint64_t prev_time = tick_time - buffer_time;
 	uint64_t audio_time;
 
 	while (os_event_try(audio->stop_event) == EAGAIN) {
-		os_sleep_ms(AUDIO_WAIT_TIME);
-
-		pthread_mutex_lock(&audio->line_mutex);
+		/* sleep to absolute deadlines so that the time spent mixing
+		 * doesn't accumulate in to the tick interval.  if the thread
+		 * fell behind, start over from the current time rather than
+		 * trying to catch up with a burst of ticks. */
+		tick_time += audio->tick_time;
+		if (!os_sleepto_ns(tick_time))
+			tick_time = os_gettime_ns();
 
 		audio_time = os_gettime_ns() - buffer_time;
 		audio_time = mix_and_output(audio, audio_time, prev_time);
 		prev_time  = audio_time;
-
-		pthread_mutex_unlock(&audio->line_mutex);
 	}
 
 	return NULL;
@@ -455,86 +1113,203 @@ static void *audio_thread(void *param)
 
 /* ------------------------------------------------------------------------- */
 
-static size_t audio_get_input_idx(audio_t video,
+static size_t audio_get_input_idx(audio_t video, size_t mix_idx,
 		void (*callback)(void *param, struct audio_data *data),
 		void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct audio_input *input = video->inputs.array+i;
-		if (input->callback == callback && input->param == param)
+		struct audio_input *input = video->inputs.array[i];
+		if (input->mix_idx  == mix_idx  &&
+		    input->callback == callback &&
+		    input->param    == param)
 			return i;
 	}
 
 	return DARRAY_INVALID;
 }
 
-static inline bool audio_input_init(struct audio_input *input,
-		struct audio_output *audio)
-{
-	if (input->conversion.format          != audio->info.format          ||
-	    input->conversion.samples_per_sec != audio->info.samples_per_sec ||
-	    input->conversion.speakers        != audio->info.speakers) {
-		struct resample_info from = {
-			.format          = audio->info.format,
-			.samples_per_sec = audio->info.samples_per_sec,
-			.speakers        = audio->info.speakers
-		};
-
-		struct resample_info to = {
-			.format          = input->conversion.format,
-			.samples_per_sec = input->conversion.samples_per_sec,
-			.speakers        = input->conversion.speakers
-		};
-
-		input->resampler = audio_resampler_create(&to, &from);
-		if (!input->resampler) {
-			blog(LOG_ERROR, "audio_input_init: Failed to "
-			                "create resampler");
-			return false;
+static inline bool same_conversion(const struct audio_convert_info *a,
+		const struct audio_convert_info *b)
+{
+	return a->format          == b->format          &&
+	       a->samples_per_sec == b->samples_per_sec &&
+	       a->speakers        == b->speakers;
+}
+
+static struct audio_converter *audio_converter_get(struct audio_output *audio,
+		size_t mix_idx, const struct audio_convert_info *info)
+{
+	struct audio_converter *converter;
+
+	for (size_t i = 0; i < audio->converters.num; i++) {
+		converter = audio->converters.array[i];
+
+		if (converter->mix_idx == mix_idx &&
+		    same_conversion(&converter->info, info)) {
+			converter->refs++;
+			return converter;
 		}
-	} else {
-		input->resampler = NULL;
 	}
 
+	struct resample_info from = {
+		.format          = AUDIO_FORMAT_FLOAT_PLANAR,
+		.samples_per_sec = audio->info.samples_per_sec,
+		.speakers        = audio->info.speakers
+	};
+
+	struct resample_info to = {
+		.format          = info->format,
+		.samples_per_sec = info->samples_per_sec,
+		.speakers        = info->speakers
+	};
+
+	converter = bzalloc(sizeof(struct audio_converter));
+	converter->mix_idx   = mix_idx;
+	converter->info      = *info;
+	converter->refs      = 1;
+	converter->resampler = audio_resampler_create(&to, &from);
+
+	if (!converter->resampler) {
+		blog(LOG_ERROR, "audio_converter_get: Failed to "
+		                "create resampler");
+		bfree(converter);
+		return NULL;
+	}
+
+	da_push_back(audio->converters, &converter);
+	return converter;
+}
+
+static void audio_converter_release(struct audio_output *audio,
+		struct audio_converter *converter)
+{
+	if (!converter || --converter->refs > 0)
+		return;
+
+	da_erase_item(audio->converters, &converter);
+	audio_resampler_destroy(converter->resampler);
+	bfree(converter);
+}
+
+static bool audio_input_init(struct audio_input *input,
+		struct audio_output *audio,
+		const struct audio_convert_info *conversion)
+{
+	struct audio_convert_info output_info = {
+		.format          = audio->info.format,
+		.samples_per_sec = audio->info.samples_per_sec,
+		.speakers        = audio->info.speakers
+	};
+	bool planar = is_audio_planar(conversion->format);
+	size_t channels = get_audio_channels(conversion->speakers);
+
+	input->planes     = planar ? channels : 1;
+	input->block_size = get_audio_bytes_per_channel(conversion->format) *
+		(planar ? 1 : channels);
+
+	if (os_sem_init(&input->sem, 0) != 0)
+		return false;
+
+	if (!same_conversion(conversion, &output_info)) {
+		input->converter = audio_converter_get(audio, input->mix_idx,
+				conversion);
+		if (!input->converter)
+			return false;
+	}
+
+	if (pthread_create(&input->thread, NULL, audio_input_thread,
+				input) != 0) {
+		blog(LOG_ERROR, "audio_input_init: Failed to create thread");
+		return false;
+	}
+
+	input->thread_initialized = true;
 	return true;
 }
 
-bool audio_output_connect(audio_t audio,
+/* releases the input's converter.  the output's input_mutex must be locked */
+static inline void audio_input_release(struct audio_output *audio,
+		struct audio_input *input)
+{
+	audio_converter_release(audio, input->converter);
+	input->converter = NULL;
+}
+
+/* stops the input's thread and frees it.  called without any of the output's
+ * locks held, because the thread may be in the middle of a callback */
+static void audio_input_free(struct audio_input *input)
+{
+	if (input->thread_initialized) {
+		os_atomic_set_long(&input->stop, 1);
+
+		/* if the input was disconnected from its own callback (such
+		 * as an encoder stopping itself after an error), the thread
+		 * can't be joined, so it frees the input when it exits */
+		if (pthread_equal(pthread_self(), input->thread)) {
+			input->free_on_exit = true;
+			pthread_detach(input->thread);
+			return;
+		}
+
+		os_sem_post(input->sem);
+		pthread_join(input->thread, NULL);
+	}
+
+	audio_input_destroy_data(input);
+}
+
+static void update_active_mixes(struct audio_output *audio)
+{
+	long mixers = 0;
+
+	for (size_t i = 0; i < audio->inputs.num; i++)
+		mixers |= 1 << audio->inputs.array[i]->mix_idx;
+
+	os_atomic_set_long(&audio->active_mixes, mixers);
+}
+
+bool audio_output_connect(audio_t audio, size_t mix_idx,
 		const struct audio_convert_info *conversion,
 		void (*callback)(void *param, struct audio_data *data),
 		void *param)
 {
 	bool success = false;
 
-	if (!audio) return false;
+	if (!audio || mix_idx >= MAX_AUDIO_MIXES) return false;
 
 	pthread_mutex_lock(&audio->input_mutex);
 
-	if (audio_get_input_idx(audio, callback, param) == DARRAY_INVALID) {
-		struct audio_input input;
-		input.callback = callback;
-		input.param    = param;
+	if (audio_get_input_idx(audio, mix_idx, callback, param) ==
+			DARRAY_INVALID) {
+		struct audio_convert_info info;
+		struct audio_input *input = bzalloc(sizeof(struct audio_input));
+		input->mix_idx  = mix_idx;
+		input->callback = callback;
+		input->param    = param;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			info = *conversion;
 		} else {
-			input.conversion.format = audio->info.format;
-			input.conversion.speakers = audio->info.speakers;
-			input.conversion.samples_per_sec =
-				audio->info.samples_per_sec;
+			info.format = audio->info.format;
+			info.speakers = audio->info.speakers;
+			info.samples_per_sec = audio->info.samples_per_sec;
 		}
 
-		if (input.conversion.format == AUDIO_FORMAT_UNKNOWN)
-			input.conversion.format = audio->info.format;
-		if (input.conversion.speakers == SPEAKERS_UNKNOWN)
-			input.conversion.speakers = audio->info.speakers;
-		if (input.conversion.samples_per_sec == 0)
-			input.conversion.samples_per_sec =
-				audio->info.samples_per_sec;
+		if (info.format == AUDIO_FORMAT_UNKNOWN)
+			info.format = audio->info.format;
+		if (info.speakers == SPEAKERS_UNKNOWN)
+			info.speakers = audio->info.speakers;
+		if (info.samples_per_sec == 0)
+			info.samples_per_sec = audio->info.samples_per_sec;
 
-		success = audio_input_init(&input, audio);
-		if (success)
+		success = audio_input_init(input, audio, &info);
+		if (success) {
 			da_push_back(audio->inputs, &input);
+			update_active_mixes(audio);
+		} else {
+			audio_input_release(audio, input);
+			audio_input_free(input);
+		}
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
@@ -542,27 +1317,62 @@ bool audio_output_connect(audio_t audio,
 	return success;
 }
 
-void audio_output_disconnect(audio_t audio,
+void audio_output_disconnect(audio_t audio, size_t mix_idx,
 		void (*callback)(void *param, struct audio_data *data),
 		void *param)
 {
+	struct audio_input *input = NULL;
+
 	if (!audio) return;
 
 	pthread_mutex_lock(&audio->input_mutex);
 
-	size_t idx = audio_get_input_idx(audio, callback, param);
+	size_t idx = audio_get_input_idx(audio, mix_idx, callback, param);
 	if (idx != DARRAY_INVALID) {
-		audio_input_free(audio->inputs.array+idx);
+		input = audio->inputs.array[idx];
+		audio_input_release(audio, input);
 		da_erase(audio->inputs, idx);
+		update_active_mixes(audio);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
+
+	/* no more data will be queued for the input, so once its thread has
+	 * stopped, the callback will never be called again */
+	if (input)
+		audio_input_free(input);
+}
+
+static inline uint32_t get_tick_frames(const struct audio_output_info *info)
+{
+	return info->tick_frames ? info->tick_frames :
+		info->samples_per_sec / DEFAULT_TICKS_PER_SEC;
+}
+
+/* the buffer must be able to absorb at least a few ticks of jitter, or
+ * lines will constantly underrun */
+static inline bool valid_buffer_time(const struct audio_output_info *info)
+{
+	uint64_t min_frames = (uint64_t)get_tick_frames(info) *
+		AUDIO_MIN_BUFFER_TICKS;
+	uint64_t buffer_frames = info->buffer_ms *
+		(uint64_t)info->samples_per_sec / 1000;
+
+	if (buffer_frames < min_frames) {
+		blog(LOG_ERROR, "audio_output_open: Buffer of %"PRIu64" ms "
+		                "is too small for a tick of %"PRIu32" frames",
+		                info->buffer_ms, get_tick_frames(info));
+		return false;
+	}
+
+	return true;
 }
 
 static inline bool valid_audio_params(struct audio_output_info *info)
 {
 	return info->format && info->name && info->samples_per_sec > 0 &&
-	       info->speakers > 0;
+	       info->speakers > 0 && get_tick_frames(info) > 0 &&
+	       valid_buffer_time(info);
 }
 
 int audio_output_open(audio_t *audio, struct audio_output_info *info)
@@ -584,6 +1394,7 @@ int audio_output_open(audio_t *audio, struct audio_output_info *info)
 	out->planes     = planar ? out->channels : 1;
 	out->block_size = (planar ? 1 : out->channels) *
 	                  get_audio_bytes_per_channel(info->format);
+	out->tick_time  = conv_frames_to_time(out, get_tick_frames(info));
 
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
@@ -627,13 +1438,22 @@ void audio_output_close(audio_t audio)
 		line = next;
 	}
 
-	for (size_t i = 0; i < audio->inputs.num; i++)
-		audio_input_free(audio->inputs.array+i);
+	for (size_t i = 0; i < audio->inputs.num; i++) {
+		audio_input_release(audio, audio->inputs.array[i]);
+		audio_input_free(audio->inputs.array[i]);
+	}
 
-	for (size_t i = 0; i < MAX_AV_PLANES; i++)
-		da_free(audio->mix_buffers[i]);
+	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+		struct audio_mix *audio_mix = audio->mixes + mix;
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			da_free(audio_mix->mix_buffers[i]);
+			da_free(audio_mix->out_buffers[i]);
+		}
+	}
 
 	da_free(audio->inputs);
+	da_free(audio->converters);
 	os_event_destroy(audio->stop_event);
 	pthread_mutex_destroy(&audio->line_mutex);
 	bfree(audio);
@@ -644,15 +1464,10 @@ audio_line_t audio_output_createline(audio_t audio, const char *name)
 	if (!audio) return NULL;
 
 	struct audio_line *line = bzalloc(sizeof(struct audio_line));
-	line->alive = true;
-	line->audio = audio;
-
-	if (pthread_mutex_init(&line->mutex, NULL) != 0) {
-		blog(LOG_ERROR, "audio_output_createline: Failed to create "
-		                "mutex");
-		bfree(line);
-		return NULL;
-	}
+	line->alive  = 1;
+	line->mixers = 1;
+	line->audio  = audio;
+	line->name  = bstrdup(name ? name : "(unnamed audio line)");
 
 	pthread_mutex_lock(&audio->line_mutex);
 
@@ -666,7 +1481,6 @@ audio_line_t audio_output_createline(audio_t audio, const char *name)
 
 	pthread_mutex_unlock(&audio->line_mutex);
 
-	line->name = bstrdup(name ? name : "(unnamed audio line)");
 	return line;
 }
 
@@ -675,14 +1489,12 @@ const struct audio_output_info *audio_output_getinfo(audio_t audio)
 	return audio ? &audio->info : NULL;
 }
 
+/* the line is freed by the audio thread once its remaining data has been
+ * mixed */
 void audio_line_destroy(struct audio_line *line)
 {
-	if (line) {
-		if (!line->buffers[0].size)
-			audio_output_removeline(line->audio, line);
-		else
-			line->alive = false;
-	}
+	if (line)
+		os_atomic_set_long(&line->alive, 0);
 }
 
 bool audio_output_active(audio_t audio)
@@ -711,165 +1523,113 @@ uint32_t audio_output_samplerate(audio_t audio)
 	return audio ? audio->info.samples_per_sec : 0;
 }
 
-/* TODO: Optimization of volume multiplication functions */
-
-static inline void mul_vol_u8bit(void *array, float volume, size_t total_num)
-{
-	uint8_t *vals = array;
-	int32_t vol = (int32_t)(volume * 127.0f);
-
-	for (size_t i = 0; i < total_num; i++) {
-		int32_t val = (int32_t)vals[i] - 128;
-		int32_t output = val * vol / 127;
-		vals[i] = (uint8_t)(CLAMP(output, MIN_S8, MAX_S8) + 128);
-	}
-}
-
-static inline void mul_vol_16bit(void *array, float volume, size_t total_num)
-{
-	uint16_t *vals = array;
-	int64_t vol = (int64_t)(volume * 32767.0f);
-
-	for (size_t i = 0; i < total_num; i++) {
-		int64_t output = (int64_t)vals[i] * vol / 32767;
-		vals[i] = (int32_t)CLAMP(output, MIN_S16, MAX_S16);
-	}
-}
-
-static inline float conv_24bit_to_float(uint8_t *vals)
+long audio_line_drift_ppm(audio_line_t line)
 {
-	int32_t val = ((int32_t)vals[0]) |
-	              ((int32_t)vals[1] << 8) |
-	              ((int32_t)vals[2] << 16);
-
-	if ((val & 0x800000) != 0)
-		val |= 0xFF000000;
-
-	return (float)val / 8388607.0f;
+	return line ? os_atomic_load_long(&line->drift_ppm) : 0;
 }
 
-static inline void conv_float_to_24bit(float fval, uint8_t *vals)
+void audio_line_set_mixers(audio_line_t line, uint32_t mixers)
 {
-	int32_t val = (int32_t)(fval * 8388607.0f);
-	vals[0] = (val)       & 0xFF;
-	vals[1] = (val >> 8)  & 0xFF;
-	vals[2] = (val >> 16) & 0xFF;
+	if (line)
+		os_atomic_set_long(&line->mixers, (long)mixers);
 }
 
-static inline void mul_vol_24bit(void *array, float volume, size_t total_num)
+uint32_t audio_line_get_mixers(audio_line_t line)
 {
-	uint8_t *vals = array;
-
-	for (size_t i = 0; i < total_num; i++) {
-		float val = conv_24bit_to_float(vals) * volume;
-		conv_float_to_24bit(CLAMP(val, -1.0f, 1.0f), vals);
-		vals += 3;
-	}
+	return line ? (uint32_t)os_atomic_load_long(&line->mixers) : 0;
 }
 
-static inline void mul_vol_32bit(void *array, float volume, size_t total_num)
+void audio_output_get_levels(audio_t audio, size_t mix_idx,
+		struct audio_levels *levels)
 {
-	int32_t *vals = array;
-	double dvol = (double)volume;
+	if (!levels)
+		return;
 
-	for (size_t i = 0; i < total_num; i++) {
-		double val = (double)vals[i] / 2147483647.0;
-		double output = val * dvol;
-		vals[i] = (int32_t)(CLAMP(output, -1.0, 1.0) * 2147483647.0);
-	}
+	if (audio && mix_idx < MAX_AUDIO_MIXES)
+		audio_levels_read(&audio->mixes[mix_idx].levels, levels);
+	else
+		memset(levels, 0, sizeof(*levels));
 }
 
-static inline void mul_vol_float(void *array, float volume, size_t total_num)
+void audio_line_get_levels(audio_line_t line, struct audio_levels *levels)
 {
-	float *vals = array;
+	if (!levels)
+		return;
 
-	for (size_t i = 0; i < total_num; i++)
-		vals[i] *= volume;
+	if (line)
+		audio_levels_read(&line->levels, levels);
+	else
+		memset(levels, 0, sizeof(*levels));
 }
 
-static void audio_line_place_data_pos(struct audio_line *line,
-		const struct audio_data *data, size_t position)
+void audio_line_get_stats(audio_line_t line, struct audio_line_stats *stats)
 {
-	bool   planar     = line->audio->planes > 1;
-	size_t total_num  = data->frames * (planar ? 1 : line->audio->channels);
-	size_t total_size = data->frames * line->audio->block_size;
-
-	for (size_t i = 0; i < line->audio->planes; i++) {
-		da_copy_array(line->volume_buffers[i], data->data[i],
-				total_size);
-
-		uint8_t *array = line->volume_buffers[i].array;
-
-		switch (line->audio->info.format) {
-		case AUDIO_FORMAT_U8BIT:
-		case AUDIO_FORMAT_U8BIT_PLANAR:
-			mul_vol_u8bit(array, data->volume, total_num);
-			break;
-		case AUDIO_FORMAT_16BIT:
-		case AUDIO_FORMAT_16BIT_PLANAR:
-			mul_vol_16bit(array, data->volume, total_num);
-			break;
-		case AUDIO_FORMAT_32BIT:
-		case AUDIO_FORMAT_32BIT_PLANAR:
-			mul_vol_32bit(array, data->volume, total_num);
-			break;
-		case AUDIO_FORMAT_FLOAT:
-		case AUDIO_FORMAT_FLOAT_PLANAR:
-			mul_vol_float(array, data->volume, total_num);
-			break;
-		case AUDIO_FORMAT_UNKNOWN:
-			blog(LOG_ERROR, "audio_line_place_data_pos: "
-					"Unknown format");
-			break;
-		}
+	if (!stats)
+		return;
 
-		circlebuf_place(&line->buffers[i], position,
-				line->volume_buffers[i].array, total_size);
+	if (line) {
+		audio_stats_read(&line->stats_data, stats);
+		stats->dropped_packets =
+			(uint64_t)os_atomic_load_long(&line->dropped_packets);
+	} else {
+		memset(stats, 0, sizeof(*stats));
 	}
 }
 
-static void audio_line_place_data(struct audio_line *line,
-		const struct audio_data *data)
+static void audio_line_packet_reserve(struct audio_line *line,
+		struct audio_line_packet *packet, uint32_t frames)
 {
-	size_t pos = ts_diff_bytes(line->audio, data->timestamp,
-			line->base_timestamp);
+	size_t channels = line->audio->channels;
 
-#ifdef DEBUG_AUDIO
-	blog(LOG_DEBUG, "data->timestamp: %llu, line->base_timestamp: %llu, "
-			"pos: %lu, bytes: %lu, buf size: %lu",
-			data->timestamp, line->base_timestamp, pos,
-			data->frames * line->audio->block_size,
-			line->buffers[0].size);
-#endif
+	if (packet->capacity >= frames)
+		return;
+
+	bfree(packet->data[0]);
+	packet->data[0] = bmalloc(frames * channels * sizeof(float));
+	for (size_t i = 1; i < channels; i++)
+		packet->data[i] = packet->data[0] + frames * i;
 
-	audio_line_place_data_pos(line, data, pos);
+	packet->capacity = frames;
 }
 
 void audio_line_output(audio_line_t line, const struct audio_data *data)
 {
-	/* TODO: prevent insertation of data too far away from expected
-	 * audio timing */
+	struct audio_output      *audio;
+	struct audio_line_packet *packet;
+	bool planar;
+	long write, next;
 
 	if (!line || !data) return;
 
-	pthread_mutex_lock(&line->mutex);
+	audio  = line->audio;
+	planar = audio->planes > 1;
+	write  = line->packet_write;
+	next   = (write + 1) & (AUDIO_LINE_QUEUE_SIZE - 1);
+
+	/* never wait on the audio thread; if it isn't keeping up, drop */
+	if (next == os_atomic_load_long(&line->packet_read)) {
+		if (!line->overflowing)
+			blog(LOG_DEBUG, "Queue for audio line '%s' is full, "
+			                "dropping audio data", line->name);
+		line->overflowing = true;
+		os_atomic_inc_long(&line->dropped_packets);
+		return;
+	}
 
-	if (!line->buffers[0].size) {
-		line->base_timestamp = data->timestamp -
-		                       line->audio->info.buffer_ms * 1000000;
-		audio_line_place_data(line, data);
+	line->overflowing = false;
 
-	} else if (line->base_timestamp <= data->timestamp) {
-		audio_line_place_data(line, data);
+	packet = line->packets + write;
+	audio_line_packet_reserve(line, packet, data->frames);
 
-	} else {
-		blog(LOG_DEBUG, "Bad timestamp for audio line '%s', "
-		                "data->timestamp: %"PRIu64", "
-		                "line->base_timestamp: %"PRIu64".  This can "
-		                "sometimes happen when there's a pause in "
-		                "the threads.", line->name, data->timestamp,
-		                line->base_timestamp);
-	}
+	for (size_t i = 0; i < audio->channels; i++)
+		audio_format_to_float(packet->data[i],
+				data->data[planar ? i : 0],
+				audio->info.format, planar ? 0 : i,
+				planar ? 1 : audio->channels, data->frames,
+				data->volume);
+
+	packet->frames    = data->frames;
+	packet->timestamp = data->timestamp;
 
-	pthread_mutex_unlock(&line->mutex);
+	os_atomic_set_long(&line->packet_write, next);
 }
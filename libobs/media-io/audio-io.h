@@ -34,6 +34,10 @@ struct audio_line;
 typedef struct audio_output *audio_t;
 typedef struct audio_line   *audio_line_t;
 
+/* number of separate mixes (tracks) an audio output produces.  each line is
+ * routed to any combination of them with a mask of (1 << mix_idx) bits. */
+#define MAX_AUDIO_MIXES 4
+
 enum audio_format {
 	AUDIO_FORMAT_UNKNOWN,
 
@@ -76,6 +80,47 @@ struct audio_output_info {
 	enum audio_format   format;
 	enum speaker_layout speakers;
 	uint64_t            buffer_ms;
+
+	/* number of frames mixed per tick of the audio thread.  0 to use the
+	 * default of 1/40th of a second.  buffer_ms must be at least
+	 * AUDIO_MIN_BUFFER_TICKS ticks long. */
+	uint32_t            tick_frames;
+};
+
+#define AUDIO_MIN_BUFFER_TICKS 2
+
+/* peak (maximum absolute sample value) and RMS of each channel over the
+ * last tick of the audio thread, in the 0.0 to 1.0 range */
+struct audio_levels {
+	float               peak[MAX_AV_PLANES];
+	float               rms[MAX_AV_PLANES];
+};
+
+/* diagnostic counters of an audio line, to find lines that are starving or
+ * flooding the mixer */
+struct audio_line_stats {
+	/* frames currently buffered for mixing */
+	uint64_t            buffered_frames;
+
+	/* timestamp of the start of the buffered data relative to the time
+	 * being mixed, in nanoseconds.  negative if the data is late. */
+	int64_t             timestamp_offset;
+
+	uint64_t            received_packets;
+
+	/* packets dropped because the line's queue was full */
+	uint64_t            dropped_packets;
+
+	/* packets rejected because their timestamp went back in time */
+	uint64_t            bad_timestamps;
+
+	/* frames discarded because they were too old to be mixed */
+	uint64_t            excess_frames;
+
+	/* ticks the line ran out of data part way through */
+	uint64_t            underruns;
+
+	long                drift_ppm;
 };
 
 struct audio_convert_info {
@@ -172,11 +217,11 @@ static inline size_t get_audio_size(enum audio_format format,
 EXPORT int audio_output_open(audio_t *audio, struct audio_output_info *info);
 EXPORT void audio_output_close(audio_t audio);
 
-EXPORT bool audio_output_connect(audio_t video,
+EXPORT bool audio_output_connect(audio_t video, size_t mix_idx,
 		const struct audio_convert_info *conversion,
 		void (*callback)(void *param, struct audio_data *data),
 		void *param);
-EXPORT void audio_output_disconnect(audio_t video,
+EXPORT void audio_output_disconnect(audio_t video, size_t mix_idx,
 		void (*callback)(void *param, struct audio_data *data),
 		void *param);
 
@@ -192,6 +237,32 @@ EXPORT audio_line_t audio_output_createline(audio_t audio, const char *name);
 EXPORT void audio_line_destroy(audio_line_t line);
 EXPORT void audio_line_output(audio_line_t line, const struct audio_data *data);
 
+/**
+ * Sets which mixes the line is mixed in to, as a mask of (1 << mix_idx)
+ * bits.  New lines are only mixed in to the first mix.
+ */
+EXPORT void audio_line_set_mixers(audio_line_t line, uint32_t mixers);
+EXPORT uint32_t audio_line_get_mixers(audio_line_t line);
+
+/**
+ * Returns the clock drift of the line's data relative to the audio output
+ * that is currently being compensated for, in parts per million.  Positive
+ * values mean the line's data is arriving faster than it's being consumed.
+ */
+EXPORT long audio_line_drift_ppm(audio_line_t line);
+
+EXPORT void audio_output_get_levels(audio_t audio, size_t mix_idx,
+		struct audio_levels *levels);
+EXPORT void audio_line_get_levels(audio_line_t line,
+		struct audio_levels *levels);
+
+/**
+ * Gets the diagnostic counters of a line.  The audio thread also logs them
+ * for every line at debug level every AUDIO_STATS_LOG_SEC seconds.
+ */
+EXPORT void audio_line_get_stats(audio_line_t line,
+		struct audio_line_stats *stats);
+
 
 #ifdef __cplusplus
 }
@@ -17,12 +17,16 @@
 
 #include "../util/bmem.h"
 #include "audio-resampler.h"
+#include "audio-convert.h"
 #include "audio-io.h"
 #include <libavutil/avutil.h>
 #include <libavformat/avformat.h>
 #include <libswresample/swresample.h>
 
 struct audio_resampler {
+	/* used instead of swresample when the sample rate doesn't change */
+	audio_convert_t     convert;
+
 	struct SwrContext   *context;
 	bool                opened;
 
@@ -83,6 +87,12 @@ audio_resampler_t audio_resampler_create(const struct resample_info *dst,
 	struct audio_resampler *rs = bzalloc(sizeof(struct audio_resampler));
 	int errcode;
 
+	if (audio_convert_supported(dst, src)) {
+		rs->convert = audio_convert_create(dst, src);
+		if (rs->convert)
+			return rs;
+	}
+
 	rs->opened        = false;
 	rs->input_freq    = src->samples_per_sec;
 	rs->input_layout  = convert_speaker_layout(src->speakers);
@@ -119,6 +129,8 @@ audio_resampler_t audio_resampler_create(const struct resample_info *dst,
 void audio_resampler_destroy(audio_resampler_t rs)
 {
 	if (rs) {
+		audio_convert_destroy(rs->convert);
+
 		if (rs->context)
 			swr_free(&rs->context);
 		if (rs->output_buffer)
@@ -134,6 +146,13 @@ bool audio_resampler_resample(audio_resampler_t rs,
 {
 	if (!rs) return false;
 
+	if (rs->convert) {
+		*ts_offset  = 0;
+		*out_frames = in_frames;
+		return audio_convert_process(rs->convert, output, input,
+				in_frames);
+	}
+
 	struct SwrContext *context = rs->context;
 	int ret;
 
@@ -86,3 +86,57 @@ void video_frame_init(struct video_frame *frame, enum video_format format,
 	}
 }
 
+static inline void copy_plane(uint8_t *dst, uint32_t dst_linesize,
+		const uint8_t *src, uint32_t src_linesize, uint32_t width,
+		uint32_t height)
+{
+	if (dst_linesize == src_linesize) {
+		memcpy(dst, src, (size_t)src_linesize * height);
+		return;
+	}
+
+	for (uint32_t y = 0; y < height; y++)
+		memcpy(dst + (size_t)dst_linesize * y,
+		       src + (size_t)src_linesize * y, width);
+}
+
+void video_frame_copy(struct video_frame *dst, const struct video_frame *src,
+		enum video_format format, uint32_t cy)
+{
+	switch (format) {
+	case VIDEO_FORMAT_NONE:
+		return;
+
+	case VIDEO_FORMAT_I420:
+		copy_plane(dst->data[0], dst->linesize[0],
+				src->data[0], src->linesize[0],
+				dst->linesize[0], cy);
+		copy_plane(dst->data[1], dst->linesize[1],
+				src->data[1], src->linesize[1],
+				dst->linesize[1], cy/2);
+		copy_plane(dst->data[2], dst->linesize[2],
+				src->data[2], src->linesize[2],
+				dst->linesize[2], cy/2);
+		break;
+
+	case VIDEO_FORMAT_NV12:
+		copy_plane(dst->data[0], dst->linesize[0],
+				src->data[0], src->linesize[0],
+				dst->linesize[0], cy);
+		copy_plane(dst->data[1], dst->linesize[1],
+				src->data[1], src->linesize[1],
+				dst->linesize[1], cy/2);
+		break;
+
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		copy_plane(dst->data[0], dst->linesize[0],
+				src->data[0], src->linesize[0],
+				dst->linesize[0], cy);
+		break;
+	}
+}
@@ -15,6 +15,8 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#pragma once
+
 #include "../util/bmem.h"
 #include "video-io.h"
 
@@ -26,6 +28,10 @@ struct video_frame {
 EXPORT void video_frame_init(struct video_frame *frame,
 		enum video_format format, uint32_t width, uint32_t height);
 
+EXPORT void video_frame_copy(struct video_frame *dst,
+		const struct video_frame *src, enum video_format format,
+		uint32_t height);
+
 static inline void video_frame_free(struct video_frame *frame)
 {
 	if (frame) {
@@ -15,7 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
-#include "obs.h"
+#include "obs-internal.h"
 #include "obs-avc.h"
 #include "util/array-serializer.h"
 
@@ -33,13 +33,6 @@ enum {
 	NAL_FILLER    = 12,
 };
 
-enum {
-	NAL_PRIORITY_DISPOSABLE = 0,
-	NAL_PRIORITY_LOW        = 1,
-	NAL_PRIORITY_HIGH       = 2,
-	NAL_PRIORITY_HIGHEST    = 3,
-};
-
 /* NOTE: I noticed that FFmpeg does some unusual special handling of certain
  * scenarios that I was unaware of, so instead of just searching for {0, 0, 1}
  * we'll just use the code from FFmpeg - http://www.ffmpeg.org/ */
@@ -91,11 +84,11 @@ const uint8_t *obs_avc_find_startcode(const uint8_t *p, const uint8_t *end)
 static inline int get_drop_priority(int priority)
 {
 	switch (priority) {
-	case NAL_PRIORITY_DISPOSABLE: return NAL_PRIORITY_DISPOSABLE;
-	case NAL_PRIORITY_LOW:        return NAL_PRIORITY_LOW;
+	case OBS_NAL_PRIORITY_DISPOSABLE: return OBS_NAL_PRIORITY_DISPOSABLE;
+	case OBS_NAL_PRIORITY_LOW:        return OBS_NAL_PRIORITY_LOW;
 	}
 
-	return NAL_PRIORITY_HIGHEST;
+	return OBS_NAL_PRIORITY_HIGHEST;
 }
 
 static void serialize_avc_data(struct serializer *s, const uint8_t *data,
@@ -128,8 +121,10 @@ static void serialize_avc_data(struct serializer *s, const uint8_t *data,
 	}
 }
 
-void obs_parse_avc_packet(struct encoder_packet *avc_packet,
-		const struct encoder_packet *src)
+/* parses the packet in to an array, leaving header_size bytes free at the
+ * start of it */
+static uint8_t *parse_avc_packet(struct encoder_packet *avc_packet,
+		const struct encoder_packet *src, size_t header_size)
 {
 	struct array_output_data output;
 	struct serializer s;
@@ -137,12 +132,36 @@ void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
+	/* start codes are usually 4 bytes, the same as the sizes that
+	 * replace them, so this is normally the final size */
+	da_reserve(output.bytes, header_size + src->size);
+	da_resize(output.bytes, header_size);
+
 	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
 			&avc_packet->priority);
 
-	avc_packet->data          = output.bytes.array;
-	avc_packet->size          = output.bytes.num;
+	avc_packet->data          = output.bytes.array + header_size;
+	avc_packet->size          = output.bytes.num - header_size;
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
+	return output.bytes.array;
+}
+
+void obs_parse_avc_packet(struct encoder_packet *avc_packet,
+		const struct encoder_packet *src)
+{
+	parse_avc_packet(avc_packet, src, 0);
+	avc_packet->refs = NULL;
+}
+
+void obs_parse_avc_packet_shared(struct encoder_packet *avc_packet,
+		const struct encoder_packet *src)
+{
+	/* same layout as obs_alloc_encoder_packet */
+	long *refs = (long*)parse_avc_packet(avc_packet, src,
+			ENCODER_PACKET_REFS_SIZE);
+	*refs = 1;
+
+	avc_packet->refs = refs;
 }
 
 static inline bool has_start_code(const uint8_t *data)
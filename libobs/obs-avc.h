@@ -25,12 +25,24 @@ extern "C" {
 
 struct encoder_packet;
 
+/* Packet priorities, from the nal_ref_idc of the packet's slices */
+enum {
+	OBS_NAL_PRIORITY_DISPOSABLE = 0,
+	OBS_NAL_PRIORITY_LOW        = 1,
+	OBS_NAL_PRIORITY_HIGH       = 2,
+	OBS_NAL_PRIORITY_HIGHEST    = 3,
+};
+
 /* Helpers for parsing AVC NAL units.  */
 
 EXPORT const uint8_t *obs_avc_find_startcode(const uint8_t *p,
 		const uint8_t *end);
 EXPORT void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 		const struct encoder_packet *src);
+/* same as obs_parse_avc_packet, but parses in to shared data with a single
+ * reference, as if allocated with obs_alloc_encoder_packet */
+EXPORT void obs_parse_avc_packet_shared(struct encoder_packet *avc_packet,
+		const struct encoder_packet *src);
 EXPORT size_t obs_parse_avc_header(uint8_t **header, const uint8_t *data,
 		size_t size);
 
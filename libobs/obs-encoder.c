@@ -15,6 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include "util/platform.h"
 #include "obs.h"
 #include "obs-internal.h"
 
@@ -41,6 +42,10 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 {
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
+	pthread_mutex_init_value(&encoder->queue_mutex);
+
+	encoder->queue_size  = DEFAULT_ENCODER_QUEUE_SIZE;
+	encoder->drop_policy = OBS_ENCODER_DROP_OLDEST;
 
 	if (!obs_context_data_init(&encoder->context, settings, name))
 		return false;
@@ -48,6 +53,8 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		return false;
 	if (pthread_mutex_init(&encoder->outputs_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->queue_mutex, NULL) != 0)
+		return false;
 
 	if (encoder->info.defaults)
 		encoder->info.defaults(encoder->context.settings);
@@ -98,6 +105,9 @@ obs_encoder_t obs_audio_encoder_create(const char *id, const char *name,
 
 static void receive_video(void *param, struct video_data *frame);
 static void receive_audio(void *param, struct audio_data *data);
+static bool start_encoder_thread(struct obs_encoder *encoder,
+		const struct video_scale_info *info);
+static void stop_encoder_thread(struct obs_encoder *encoder);
 
 static inline struct audio_convert_info *get_audio_info(
 		struct obs_encoder *encoder, struct audio_convert_info *info)
@@ -129,19 +139,44 @@ static inline struct video_scale_info *get_video_info(
 	return NULL;
 }
 
+static void reset_stats(struct obs_encoder *encoder)
+{
+	pthread_mutex_lock(&encoder->queue_mutex);
+
+	memset(&encoder->stats, 0, sizeof(encoder->stats));
+	if (encoder->info.type == OBS_ENCODER_VIDEO)
+		encoder->stats.queue_size = (uint32_t)encoder->queue_size;
+
+	encoder->stats_window_ts      = 0;
+	encoder->stats_window_bytes   = 0;
+	encoder->stats_window_packets = 0;
+	encoder->last_keyframe_packet = 0;
+
+	pthread_mutex_unlock(&encoder->queue_mutex);
+}
+
 static void add_connection(struct obs_encoder *encoder)
 {
 	struct audio_convert_info audio_info = {0};
 	struct video_scale_info   video_info = {0};
 
+	reset_stats(encoder);
+
 	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		get_audio_info(encoder, &audio_info);
-		audio_output_connect(encoder->media, &audio_info, receive_audio,
-				encoder);
+		audio_output_connect(encoder->media, encoder->mixer_idx,
+				&audio_info, receive_audio, encoder);
 	} else {
 		struct video_scale_info *info = NULL;
 
 		info = get_video_info(encoder, &video_info);
+
+		/* the thread of a previous connection may have stopped
+		 * itself after an error, but not been joined yet */
+		stop_encoder_thread(encoder);
+		if (!start_encoder_thread(encoder, info))
+			return;
+
 		video_output_connect(encoder->media, info, receive_video,
 				encoder);
 	}
@@ -149,16 +184,50 @@ static void add_connection(struct obs_encoder *encoder)
 	encoder->active = true;
 }
 
+/* discards an update queued for the encoding thread, returns whether there
+ * was one, or whether temporary settings are in effect */
+static bool clear_pending_update(struct obs_encoder *encoder)
+{
+	bool pending;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	pending = encoder->pending_settings != NULL || encoder->live_settings;
+	obs_data_release(encoder->pending_settings);
+	encoder->pending_settings = NULL;
+	encoder->live_settings    = false;
+	os_atomic_set_long(&encoder->update_pending, 0);
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	return pending;
+}
+
 static void remove_connection(struct obs_encoder *encoder)
 {
-	if (encoder->info.type == OBS_ENCODER_AUDIO)
-		audio_output_disconnect(encoder->media, receive_audio,
-				encoder);
-	else
+	if (encoder->info.type == OBS_ENCODER_AUDIO) {
+		audio_output_disconnect(encoder->media, encoder->mixer_idx,
+				receive_audio, encoder);
+	} else {
 		video_output_disconnect(encoder->media, receive_video,
 				encoder);
 
+		/* the encoder's own thread can't join itself, it just exits
+		 * and is joined later */
+		if (encoder->thread_active &&
+		    pthread_equal(pthread_self(), encoder->thread))
+			os_atomic_set_long(&encoder->thread_stop, 1);
+		else
+			stop_encoder_thread(encoder);
+	}
+
 	encoder->active = false;
+
+	/* an update that didn't make it to the encoding thread before it
+	 * stopped is applied now, rather than on the next start where it
+	 * could overwrite newer settings.  temporary settings from
+	 * obs_encoder_update_live are reverted the same way */
+	if (clear_pending_update(encoder))
+		encoder->info.update(encoder->context.data,
+				encoder->context.settings);
 }
 
 static inline void free_audio_buffers(struct obs_encoder *encoder)
@@ -182,12 +251,15 @@ static void obs_encoder_actually_destroy(obs_encoder_t encoder)
 		pthread_mutex_unlock(&encoder->outputs_mutex);
 
 		free_audio_buffers(encoder);
+		stop_encoder_thread(encoder);
 
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
 		da_free(encoder->callbacks);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
+		pthread_mutex_destroy(&encoder->queue_mutex);
+		obs_data_release(encoder->pending_settings);
 		obs_context_data_free(&encoder->context);
 		bfree(encoder);
 	}
@@ -254,15 +326,58 @@ obs_properties_t obs_encoder_properties(obs_encoder_t encoder,
 	return NULL;
 }
 
+/* queues the encoder's settings, plus any temporary changes, for the
+ * encoding thread */
+static void queue_update(struct obs_encoder *encoder, obs_data_t live)
+{
+	obs_data_t copy = get_defaults(&encoder->info);
+	obs_data_apply(copy, encoder->context.settings);
+	if (live)
+		obs_data_apply(copy, live);
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	obs_data_release(encoder->pending_settings);
+	encoder->pending_settings = copy;
+	if (live)
+		encoder->live_settings = true;
+	os_atomic_set_long(&encoder->update_pending, 1);
+	pthread_mutex_unlock(&encoder->queue_mutex);
+}
+
 void obs_encoder_update(obs_encoder_t encoder, obs_data_t settings)
 {
 	if (!encoder) return;
 
 	obs_data_apply(encoder->context.settings, settings);
 
-	if (encoder->info.update && encoder->context.data)
+	if (!encoder->info.update || !encoder->context.data)
+		return;
+
+	/* while active, the encoder is being used by its encoding thread, so
+	 * it's given a copy of the settings on that thread instead */
+	if (encoder->active) {
+		queue_update(encoder, NULL);
+	} else {
+		clear_pending_update(encoder);
 		encoder->info.update(encoder->context.data,
 				encoder->context.settings);
+	}
+}
+
+bool obs_encoder_update_live(obs_encoder_t encoder, obs_data_t settings)
+{
+	if (!encoder || !encoder->info.update || !encoder->context.data)
+		return false;
+	if (!encoder->active)
+		return false;
+
+	queue_update(encoder, settings);
+	return true;
+}
+
+bool obs_encoder_active(obs_encoder_t encoder)
+{
+	return (encoder != NULL) ? encoder->active : false;
 }
 
 bool obs_encoder_get_extra_data(obs_encoder_t encoder, uint8_t **extra_data,
@@ -432,6 +547,63 @@ video_t obs_encoder_video(obs_encoder_t encoder)
 		encoder->media : NULL;
 }
 
+void obs_encoder_set_mixer(obs_encoder_t encoder, size_t mixer_idx)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_AUDIO)
+		return;
+	if (mixer_idx >= MAX_AUDIO_MIXES)
+		return;
+
+	if (encoder->active) {
+		blog(LOG_WARNING, "obs_encoder_set_mixer: cannot change the "
+		                  "mix of an active encoder");
+		return;
+	}
+
+	encoder->mixer_idx = mixer_idx;
+}
+
+size_t obs_encoder_get_mixer(obs_encoder_t encoder)
+{
+	return encoder ? encoder->mixer_idx : 0;
+}
+
+void obs_encoder_set_queue(obs_encoder_t encoder, size_t size,
+		enum obs_encoder_drop_policy policy)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO || !size)
+		return;
+
+	if (encoder->active) {
+		blog(LOG_WARNING, "obs_encoder_set_queue: cannot change the "
+		                  "queue of an active encoder");
+		return;
+	}
+
+	encoder->queue_size  = size;
+	encoder->drop_policy = policy;
+}
+
+void obs_encoder_get_stats(obs_encoder_t encoder,
+		struct obs_encoder_stats *stats)
+{
+	if (!stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+	if (!encoder)
+		return;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	*stats = encoder->stats;
+	stats->queue_depth = (uint32_t)encoder->queue_count;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	if (stats->frames_encoded > stats->packets_output)
+		stats->frames_delayed = (uint32_t)(stats->frames_encoded -
+				stats->packets_output);
+}
+
 audio_t obs_encoder_audio(obs_encoder_t encoder)
 {
 	return (encoder && encoder->info.type == OBS_ENCODER_AUDIO) ?
@@ -450,7 +622,6 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 		struct encoder_callback *cb, struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
-	DARRAY(uint8_t)       data;
 	uint8_t               *sei;
 	size_t                size;
 
@@ -458,24 +629,20 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	if (!packet->keyframe)
 		return;
 
-	da_init(data);
+	cb->sent_first_packet = true;
 
 	if (!get_sei(encoder, &sei, &size)) {
 		cb->new_packet(cb->param, packet);
 		return;
 	}
 
-	da_push_back_array(data, sei, size);
-	da_push_back_array(data, packet->data, packet->size);
-
-	first_packet      = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	first_packet = *packet;
+	obs_alloc_encoder_packet(&first_packet, size + packet->size);
+	memcpy(first_packet.data, sei, size);
+	memcpy(first_packet.data + size, packet->data, packet->size);
 
 	cb->new_packet(cb->param, &first_packet);
-	cb->sent_first_packet = true;
-
-	da_free(data);
+	obs_release_encoder_packet(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -498,18 +665,114 @@ static void full_stop(struct obs_encoder *encoder)
 	}
 }
 
+static inline size_t encode_time_bucket(uint64_t encode_time)
+{
+	uint64_t limit  = 1000000;
+	size_t   bucket = 0;
+
+	while (bucket < OBS_ENCODER_TIME_BUCKETS - 1 && encode_time >= limit) {
+		limit *= 2;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static void record_encode_stats(struct obs_encoder *encoder,
+		const struct encoder_frame *frame,
+		const struct encoder_packet *pkt,
+		uint64_t end_time, uint64_t encode_time)
+{
+	struct obs_encoder_stats *stats = &encoder->stats;
+	uint64_t frame_time;
+	uint64_t elapsed;
+
+	frame_time = (uint64_t)frame->frames * encoder->timebase_num *
+		1000000000ULL / encoder->timebase_den;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+
+	stats->frames_encoded++;
+	stats->encode_time_total_ns += encode_time;
+	stats->encode_time_hist[encode_time_bucket(encode_time)]++;
+
+	if (encode_time > stats->encode_time_max_ns)
+		stats->encode_time_max_ns = encode_time;
+	if (encode_time > frame_time)
+		stats->slow_frames++;
+
+	if (pkt) {
+		stats->packets_output++;
+		stats->bytes_output += pkt->size;
+
+		if (encoder->info.type == OBS_ENCODER_VIDEO && pkt->keyframe) {
+			if (encoder->last_keyframe_packet)
+				stats->keyframe_interval = (uint32_t)(
+					stats->packets_output -
+					encoder->last_keyframe_packet);
+
+			encoder->last_keyframe_packet = stats->packets_output;
+			stats->keyframes++;
+		}
+
+		encoder->stats_window_bytes += pkt->size;
+		encoder->stats_window_packets++;
+	}
+
+	if (!encoder->stats_window_ts)
+		encoder->stats_window_ts = end_time;
+
+	elapsed = end_time - encoder->stats_window_ts;
+	if (elapsed >= 1000000000ULL) {
+		stats->bytes_per_sec = encoder->stats_window_bytes *
+			1000000000ULL / elapsed;
+		stats->packets_per_sec = (uint32_t)(
+			encoder->stats_window_packets *
+			1000000000ULL / elapsed);
+
+		encoder->stats_window_ts      = end_time;
+		encoder->stats_window_bytes   = 0;
+		encoder->stats_window_packets = 0;
+	}
+
+	pthread_mutex_unlock(&encoder->queue_mutex);
+}
+
+static void apply_pending_update(struct obs_encoder *encoder)
+{
+	obs_data_t settings;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	settings = encoder->pending_settings;
+	encoder->pending_settings = NULL;
+	os_atomic_set_long(&encoder->update_pending, 0);
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	if (settings) {
+		encoder->info.update(encoder->context.data, settings);
+		obs_data_release(settings);
+	}
+}
+
 static inline void do_encode(struct obs_encoder *encoder,
 		struct encoder_frame *frame)
 {
 	struct encoder_packet pkt = {0};
 	bool received = false;
 	bool success;
+	uint64_t start_time, end_time;
+
+	if (os_atomic_load_long(&encoder->update_pending))
+		apply_pending_update(encoder);
 
 	pkt.timebase_num = encoder->timebase_num;
 	pkt.timebase_den = encoder->timebase_den;
 
+	start_time = os_gettime_ns();
 	success = encoder->info.encode(encoder->context.data, frame, &pkt,
 			&received);
+	end_time = os_gettime_ns();
+
 	if (!success) {
 		full_stop(encoder);
 		blog(LOG_ERROR, "Error encoding with encoder '%s'",
@@ -517,11 +780,23 @@ static inline void do_encode(struct obs_encoder *encoder,
 		return;
 	}
 
+	record_encode_stats(encoder, frame, received ? &pkt : NULL,
+			end_time, end_time - start_time);
+
 	if (received) {
 		/* we use system time here to ensure sync with other encoders,
 		 * you do not want to use relative timestamps here */
 		pkt.dts_usec = encoder->start_ts / 1000 + packet_dts_usec(&pkt);
 
+		/* copy the packet into shared data once (unless the encoder
+		 * already allocated it that way) so that every output
+		 * references the same data rather than duplicating it */
+		if (!pkt.refs) {
+			struct encoder_packet shared;
+			obs_ref_encoder_packet(&shared, &pkt);
+			pkt = shared;
+		}
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = 0; i < encoder->callbacks.num; i++) {
@@ -531,30 +806,199 @@ static inline void do_encode(struct obs_encoder *encoder,
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_release_encoder_packet(&pkt);
 	}
 }
 
-static void receive_video(void *param, struct video_data *frame)
+/* ------------------------------------------------------------------------- */
+/* video encoder thread */
+
+static void free_encoder_queue(struct obs_encoder *encoder)
 {
-	struct obs_encoder    *encoder  = param;
-	struct encoder_frame  enc_frame;
+	if (encoder->queue) {
+		for (size_t i = 0; i < encoder->queue_size; i++)
+			video_frame_free(&encoder->queue[i].frame);
+		bfree(encoder->queue);
+		encoder->queue = NULL;
+	}
 
-	memset(&enc_frame, 0, sizeof(struct encoder_frame));
+	video_frame_free(&encoder->encode_frame.frame);
+	encoder->queue_start = 0;
+	encoder->queue_count = 0;
+}
 
-	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-		enc_frame.data[i]     = frame->data[i];
-		enc_frame.linesize[i] = frame->linesize[i];
+/* takes the next frame out of the queue.  the queued frame and the thread's
+ * own frame are swapped so that the data doesn't have to be copied again,
+ * and so that the queue can keep being filled while the frame is encoded */
+static bool pop_queued_frame(struct obs_encoder *encoder)
+{
+	struct encoder_queued_frame *queued;
+	struct encoder_queued_frame temp;
+	bool success = false;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+
+	if (encoder->queue_count) {
+		queued = encoder->queue + encoder->queue_start;
+
+		temp                  = *queued;
+		*queued               = encoder->encode_frame;
+		encoder->encode_frame = temp;
+
+		encoder->queue_start = (encoder->queue_start + 1) %
+			encoder->queue_size;
+		encoder->queue_count--;
+		success = true;
 	}
 
+	pthread_mutex_unlock(&encoder->queue_mutex);
+	return success;
+}
+
+static void *encoder_thread(void *param)
+{
+	struct obs_encoder *encoder = param;
+
+	while (os_sem_wait(encoder->queue_sem) == 0) {
+		struct encoder_frame enc_frame;
+		struct video_frame   *frame = &encoder->encode_frame.frame;
+
+		if (os_atomic_load_long(&encoder->thread_stop))
+			break;
+		if (!pop_queued_frame(encoder))
+			continue;
+
+		memset(&enc_frame, 0, sizeof(struct encoder_frame));
+
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			enc_frame.data[i]     = frame->data[i];
+			enc_frame.linesize[i] = frame->linesize[i];
+		}
+
+		enc_frame.frames = 1;
+		enc_frame.pts    = encoder->encode_frame.pts;
+
+		do_encode(encoder, &enc_frame);
+	}
+
+	return NULL;
+}
+
+static bool start_encoder_thread(struct obs_encoder *encoder,
+		const struct video_scale_info *info)
+{
+	const struct video_output_info *voi;
+	voi = video_output_getinfo(encoder->media);
+
+	encoder->frame_format = voi->format;
+	encoder->frame_width  = voi->width;
+	encoder->frame_height = voi->height;
+
+	if (info) {
+		if (info->format != VIDEO_FORMAT_NONE)
+			encoder->frame_format = info->format;
+		if (info->width)
+			encoder->frame_width  = info->width;
+		if (info->height)
+			encoder->frame_height = info->height;
+	}
+
+	encoder->queue = bzalloc(sizeof(struct encoder_queued_frame) *
+			encoder->queue_size);
+
+	for (size_t i = 0; i < encoder->queue_size; i++)
+		video_frame_init(&encoder->queue[i].frame,
+				encoder->frame_format, encoder->frame_width,
+				encoder->frame_height);
+	video_frame_init(&encoder->encode_frame.frame, encoder->frame_format,
+			encoder->frame_width, encoder->frame_height);
+
+	encoder->thread_stop = 0;
+
+	if (os_sem_init(&encoder->queue_sem, 0) != 0)
+		goto fail;
+	if (pthread_create(&encoder->thread, NULL, encoder_thread,
+				encoder) != 0)
+		goto fail;
+
+	encoder->thread_active = true;
+	return true;
+
+fail:
+	blog(LOG_ERROR, "Failed to start the thread of encoder '%s'",
+			encoder->context.name);
+	os_sem_destroy(encoder->queue_sem);
+	encoder->queue_sem = NULL;
+	free_encoder_queue(encoder);
+	return false;
+}
+
+static void stop_encoder_thread(struct obs_encoder *encoder)
+{
+	if (!encoder->thread_active)
+		return;
+
+	os_atomic_set_long(&encoder->thread_stop, 1);
+	os_sem_post(encoder->queue_sem);
+	pthread_join(encoder->thread, NULL);
+
+	os_sem_destroy(encoder->queue_sem);
+	encoder->queue_sem     = NULL;
+	encoder->thread_active = false;
+	free_encoder_queue(encoder);
+}
+
+/* copies the frame in to the queue, dropping a frame if the queue is full */
+static void receive_video(void *param, struct video_data *frame)
+{
+	struct obs_encoder          *encoder = param;
+	struct encoder_queued_frame *queued;
+	struct video_frame          src;
+	size_t                      idx;
+
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
-	enc_frame.frames = 1;
-	enc_frame.pts    = encoder->cur_pts;
+	/* the pts advances even if the frame is dropped, so that timing is
+	 * kept for the frames that are encoded */
+	int64_t pts = encoder->cur_pts;
+	encoder->cur_pts += encoder->timebase_num;
 
-	do_encode(encoder, &enc_frame);
+	pthread_mutex_lock(&encoder->queue_mutex);
 
-	encoder->cur_pts += encoder->timebase_num;
+	encoder->stats.frames_received++;
+
+	if (encoder->queue_count == encoder->queue_size) {
+		encoder->stats.frames_dropped++;
+
+		if (encoder->drop_policy == OBS_ENCODER_DROP_NEWEST) {
+			pthread_mutex_unlock(&encoder->queue_mutex);
+			return;
+		}
+
+		encoder->queue_start = (encoder->queue_start + 1) %
+			encoder->queue_size;
+		encoder->queue_count--;
+	}
+
+	idx = (encoder->queue_start + encoder->queue_count) %
+		encoder->queue_size;
+	queued = encoder->queue + idx;
+
+	memcpy(src.data, frame->data, sizeof(src.data));
+	memcpy(src.linesize, frame->linesize, sizeof(src.linesize));
+	video_frame_copy(&queued->frame, &src, encoder->frame_format,
+			encoder->frame_height);
+	queued->pts = pts;
+
+	encoder->queue_count++;
+	if (encoder->queue_count > encoder->stats.queue_peak)
+		encoder->stats.queue_peak = (uint32_t)encoder->queue_count;
+
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	os_sem_post(encoder->queue_sem);
 }
 
 static bool buffer_audio(struct obs_encoder *encoder, struct audio_data *data)
@@ -652,15 +1096,49 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
-void obs_duplicate_encoder_packet(struct encoder_packet *dst,
+void obs_alloc_encoder_packet(struct encoder_packet *packet, size_t size)
+{
+	uint8_t *mem  = bmalloc(ENCODER_PACKET_REFS_SIZE + size);
+	long    *refs = (long*)mem;
+	*refs = 1;
+
+	packet->refs = refs;
+	packet->data = mem + ENCODER_PACKET_REFS_SIZE;
+	packet->size = size;
+}
+
+void obs_ref_encoder_packet(struct encoder_packet *dst,
 		const struct encoder_packet *src)
 {
 	*dst = *src;
-	dst->data = bmemdup(src->data, src->size);
+
+	if (src->refs) {
+		os_atomic_inc_long(src->refs);
+	} else {
+		obs_alloc_encoder_packet(dst, src->size);
+		memcpy(dst->data, src->data, src->size);
+	}
 }
 
-void obs_free_encoder_packet(struct encoder_packet *packet)
+void obs_release_encoder_packet(struct encoder_packet *packet)
 {
-	bfree(packet->data);
+	if (packet->refs) {
+		if (os_atomic_dec_long(packet->refs) == 0)
+			bfree((void*)packet->refs);
+	} else {
+		bfree(packet->data);
+	}
+
 	memset(packet, 0, sizeof(struct encoder_packet));
 }
+
+void obs_duplicate_encoder_packet(struct encoder_packet *dst,
+		const struct encoder_packet *src)
+{
+	obs_ref_encoder_packet(dst, src);
+}
+
+void obs_free_encoder_packet(struct encoder_packet *packet)
+{
+	obs_release_encoder_packet(packet);
+}
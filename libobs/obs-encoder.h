@@ -59,6 +59,13 @@ struct encoder_packet {
 	 * priority or higher to continue transmission.
 	 */
 	int                   drop_priority;
+
+	/**
+	 * Reference count of the packet data, or NULL if the data is not
+	 * shared.  Shared packet data is immutable, and is freed when the
+	 * last reference is released.
+	 */
+	volatile long         *refs;
 };
 
 /** Encoder input frame */
@@ -131,7 +138,11 @@ struct obs_encoder_info {
 	 * @param       data             Data associated with this encoder
 	 *                               context
 	 * @param[in]   frame            Raw audio/video data to encode
-	 * @param[out]  packet           Encoder packet output, if any
+	 * @param[out]  packet           Encoder packet output, if any.  The
+	 *                               data may point to an internal
+	 *                               buffer, or be allocated with
+	 *                               obs_alloc_encoder_packet, in which
+	 *                               case ownership is passed to libobs
 	 * @param[out]  received_packet  Set to true if a packet was received,
 	 *                               false otherwise
 	 * @return                       true if successful, false otherwise.
@@ -164,6 +175,12 @@ struct obs_encoder_info {
 	 * Updates the settings for this encoder (usually used for things like
 	 * changeing birate while active)
 	 *
+	 * While the encoder is active this is called on the encoding thread
+	 * before the next frame is encoded, and should only change settings
+	 * that are safe to change without restarting the encoder or sending
+	 * new headers (such as the bitrate).  While idle, all settings may be
+	 * applied.  obs_encoder_active tells the two cases apart.
+	 *
 	 * @param  data      Data associated with this encoder context
 	 * @param  settings  New settings for this encoder
 	 * @return           true if successful, false otherwise
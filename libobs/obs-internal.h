@@ -29,6 +29,7 @@
 
 #include "media-io/audio-resampler.h"
 #include "media-io/video-io.h"
+#include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
 
 #include "obs.h"
@@ -126,14 +127,34 @@ struct obs_core_video {
 	struct obs_display              main_display;
 };
 
+/* minimum interval between audio level signals, in nanoseconds */
+#define AUDIO_LEVEL_INTERVAL 50000000ULL
+
 struct obs_core_audio {
 	/* TODO: sound output subsystem */
 	audio_t                         audio;
 
 	float                           user_volume;
 	float                           present_volume;
+
+	uint64_t                        last_level_time;
 };
 
+/* gets the highest RMS and peak values of all channels */
+static inline void get_max_audio_levels(const struct audio_levels *levels,
+		float *level, float *peak)
+{
+	*level = 0.0f;
+	*peak  = 0.0f;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		if (levels->rms[i] > *level)
+			*level = levels->rms[i];
+		if (levels->peak[i] > *peak)
+			*peak = levels->peak[i];
+	}
+}
+
 /* user sources, output channels, and displays */
 struct obs_core_data {
 	pthread_mutex_t                 user_sources_mutex;
@@ -257,6 +278,7 @@ struct obs_source {
 	float                           user_volume;
 	float                           present_volume;
 	int64_t                         sync_offset;
+	uint64_t                        last_level_time;
 
 	/* transition volume is meant to store the sum of transitioning volumes
 	 * of a source, i.e. if a source is within both the "to" and "from"
@@ -352,6 +374,13 @@ struct encoder_callback {
 	void *param;
 };
 
+#define DEFAULT_ENCODER_QUEUE_SIZE 8
+
+struct encoder_queued_frame {
+	struct video_frame              frame;
+	int64_t                         pts;
+};
+
 struct obs_encoder {
 	struct obs_context_data         context;
 	struct obs_encoder_info         info;
@@ -362,6 +391,44 @@ struct obs_encoder {
 	size_t                          framesize;
 	size_t                          framesize_bytes;
 
+	/* mix of the audio output an audio encoder encodes */
+	size_t                          mixer_idx;
+
+	/* video encoders encode on their own thread.  the video output only
+	 * copies frames in to the queue (audio encoders are already called
+	 * from their own thread by the audio output) */
+	pthread_t                       thread;
+	bool                            thread_active;
+	volatile long                   thread_stop;
+	os_sem_t                        queue_sem;
+	pthread_mutex_t                 queue_mutex;
+	struct encoder_queued_frame     *queue;
+	size_t                          queue_size;
+	size_t                          queue_start;
+	size_t                          queue_count;
+	enum obs_encoder_drop_policy    drop_policy;
+	struct encoder_queued_frame     encode_frame;
+	enum video_format               frame_format;
+	uint32_t                        frame_width;
+	uint32_t                        frame_height;
+	struct obs_encoder_stats        stats;
+
+	/* settings updated while active, applied on the encoding thread
+	 * before the next frame (locked by queue_mutex) */
+	obs_data_t                      pending_settings;
+	volatile long                   update_pending;
+
+	/* whether temporary settings from obs_encoder_update_live have been
+	 * queued, which are reverted when the encoder stops (locked by
+	 * queue_mutex) */
+	bool                            live_settings;
+
+	/* output of the current second, for bytes/packets per second */
+	uint64_t                        stats_window_ts;
+	uint64_t                        stats_window_bytes;
+	uint64_t                        stats_window_packets;
+	uint64_t                        last_keyframe_packet;
+
 	bool                            active;
 
 	uint32_t                        timebase_num;
@@ -406,6 +473,12 @@ extern void obs_encoder_add_output(struct obs_encoder *encoder,
 extern void obs_encoder_remove_output(struct obs_encoder *encoder,
 		struct obs_output *output);
 
+/* the reference count of shared packet data is stored in a header directly
+ * before the data.  the header is padded so that the data keeps the 32 byte
+ * alignment of bmalloc (a bare long would only leave it 4 byte aligned on
+ * 64bit windows) */
+#define ENCODER_PACKET_REFS_SIZE 32
+
 /* ------------------------------------------------------------------------- */
 /* services */
 
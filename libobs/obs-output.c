@@ -97,7 +97,8 @@ fail:
 static inline void free_packets(struct obs_output *output)
 {
 	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_free_encoder_packet(output->interleaved_packets.array+i);
+		obs_release_encoder_packet(
+				output->interleaved_packets.array+i);
 	da_free(output->interleaved_packets);
 }
 
@@ -391,7 +392,7 @@ static bool prepare_interleaved_packet(struct obs_output *output,
 		offset = output->audio_offset;
 	}
 
-	obs_duplicate_encoder_packet(out, in);
+	obs_ref_encoder_packet(out, in);
 	out->dts -= offset;
 	out->pts -= offset;
 
@@ -411,7 +412,7 @@ static inline void send_interleaved(struct obs_output *output)
 	da_erase(output->interleaved_packets, 0);
 
 	output->info.encoded_packet(output->context.data, &out);
-	obs_free_encoder_packet(&out);
+	obs_release_encoder_packet(&out);
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -476,7 +477,7 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 					output->info.raw_video,
 					output->context.data);
 		if (has_audio)
-			audio_output_connect(output->audio,
+			audio_output_connect(output->audio, 0,
 					get_audio_conversion(output),
 					output->info.raw_audio,
 					output->context.data);
@@ -610,7 +611,7 @@ void obs_output_end_data_capture(obs_output_t output)
 					output->info.raw_video,
 					output->context.data);
 		if (has_audio)
-			audio_output_disconnect(output->audio,
+			audio_output_disconnect(output->audio, 0,
 					output->info.raw_audio,
 					output->context.data);
 	}
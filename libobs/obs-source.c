@@ -79,6 +79,7 @@ static const char *source_signals[] = {
 	"void show(ptr source)",
 	"void hide(ptr source)",
 	"void volume(ptr source, in out float volume)",
+	"void volume_level(ptr source, float level, float peak)",
 	NULL
 };
 
@@ -522,6 +523,32 @@ static inline void handle_ts_jump(obs_source_t source, uint64_t expected,
 		reset_audio_timing(source, ts);
 }
 
+/* the levels themselves are measured by the audio thread while mixing, this
+ * just periodically notifies of the latest values */
+static void signal_audio_levels(obs_source_t source)
+{
+	struct calldata     data = {0};
+	struct audio_levels levels;
+	uint64_t            cur_time = os_gettime_ns();
+	float               level, peak;
+
+	if (cur_time - source->last_level_time < AUDIO_LEVEL_INTERVAL)
+		return;
+
+	source->last_level_time = cur_time;
+
+	audio_line_get_levels(source->audio_line, &levels);
+	get_max_audio_levels(&levels, &level, &peak);
+
+	calldata_setptr(&data, "source", source);
+	calldata_setfloat(&data, "level", level);
+	calldata_setfloat(&data, "peak", peak);
+
+	signal_handler_signal(source->context.signals, "volume_level", &data);
+
+	calldata_free(&data);
+}
+
 static void source_output_audio_line(obs_source_t source,
 		const struct audio_data *data)
 {
@@ -562,6 +589,7 @@ static void source_output_audio_line(obs_source_t source,
 		obs->audio.user_volume * obs->audio.present_volume;
 
 	audio_line_output(source->audio_line, &in);
+	signal_audio_levels(source);
 }
 
 enum convert_type {
@@ -1262,8 +1290,11 @@ static inline void copy_audio_data(obs_source_t source,
 		source->audio_storage_size = size;
 }
 
-/* resamples/remixes new audio to the designated main audio output format */
-static void process_audio(obs_source_t source, const struct source_audio *audio)
+/* resamples/remixes new audio to the designated main audio output format.
+ * the data isn't copied; out points to either the source's data or the
+ * resampler's output. */
+static bool process_audio(obs_source_t source, const struct source_audio *audio,
+		struct filtered_audio *out)
 {
 	if (source->sample_info.samples_per_sec != audio->samples_per_sec ||
 	    source->sample_info.format          != audio->format          ||
@@ -1271,41 +1302,62 @@ static void process_audio(obs_source_t source, const struct source_audio *audio)
 		reset_resampler(source, audio);
 
 	if (source->audio_failed)
-		return;
+		return false;
+
+	memset(out, 0, sizeof(*out));
 
 	if (source->resampler) {
-		uint8_t  *output[MAX_AV_PLANES];
-		uint32_t frames;
 		uint64_t offset;
 
-		memset(output, 0, sizeof(output));
-
-		audio_resampler_resample(source->resampler,
-				output, &frames, &offset,
-				audio->data, audio->frames);
+		if (!audio_resampler_resample(source->resampler,
+				out->data, &out->frames, &offset,
+				audio->data, audio->frames))
+			return false;
 
-		copy_audio_data(source, (const uint8_t *const *)output, frames,
-				audio->timestamp - offset);
+		out->timestamp = audio->timestamp - offset;
 	} else {
-		copy_audio_data(source, audio->data, audio->frames,
-				audio->timestamp);
+		for (size_t i = 0; i < MAX_AV_PLANES; i++)
+			out->data[i] = (uint8_t*)audio->data[i];
+
+		out->frames    = audio->frames;
+		out->timestamp = audio->timestamp;
 	}
+
+	return true;
+}
+
+/* filters may modify the data they're given, so the data is only copied in
+ * to the source's own storage if there are any audio filters */
+static inline bool has_audio_filters(obs_source_t source)
+{
+	for (size_t i = 0; i < source->filters.num; i++)
+		if (source->filters.array[i]->info.filter_audio)
+			return true;
+
+	return false;
 }
 
 void obs_source_output_audio(obs_source_t source,
 		const struct source_audio *audio)
 {
 	uint32_t flags;
-	struct filtered_audio *output;
+	struct filtered_audio processed;
+	struct filtered_audio *output = &processed;
 
 	if (!source || !audio)
 		return;
 
 	flags = source->info.output_flags;
-	process_audio(source, audio);
+	if (!process_audio(source, audio, &processed))
+		return;
 
 	pthread_mutex_lock(&source->filter_mutex);
-	output = filter_async_audio(source, &source->audio_data);
+
+	if (has_audio_filters(source)) {
+		copy_audio_data(source, (const uint8_t *const *)processed.data,
+				processed.frames, processed.timestamp);
+		output = filter_async_audio(source, &source->audio_data);
+	}
 
 	if (output) {
 		bool async = (flags & OBS_SOURCE_ASYNC) != 0;
@@ -1600,12 +1652,35 @@ float obs_source_get_present_volume(obs_source_t source)
 	return source ? source->present_volume : 0.0f;
 }
 
+void obs_source_set_audio_mixers(obs_source_t source, uint32_t mixers)
+{
+	if (source)
+		audio_line_set_mixers(source->audio_line, mixers);
+}
+
+uint32_t obs_source_get_audio_mixers(obs_source_t source)
+{
+	return source ? audio_line_get_mixers(source->audio_line) : 0;
+}
+
 void obs_source_set_sync_offset(obs_source_t source, int64_t offset)
 {
 	if (source)
 		source->sync_offset = offset;
 }
 
+void obs_source_get_audio_levels(obs_source_t source,
+		struct audio_levels *levels)
+{
+	if (!levels)
+		return;
+
+	if (source)
+		audio_line_get_levels(source->audio_line, levels);
+	else
+		memset(levels, 0, sizeof(*levels));
+}
+
 int64_t obs_source_get_sync_offset(obs_source_t source)
 {
 	return source ? source->sync_offset : 0;
@@ -423,6 +423,32 @@ static inline void output_frame(uint64_t timestamp)
 		video->cur_texture = 0;
 }
 
+/* source levels are signaled from their audio threads, but the master mix
+ * has no thread of its own outside of the audio thread, so signal its levels
+ * from here */
+static inline void signal_master_levels(uint64_t cur_time)
+{
+	struct obs_core_audio *audio = &obs->audio;
+	struct calldata       data = {0};
+	struct audio_levels   levels;
+	float                 level, peak;
+
+	if (cur_time - audio->last_level_time < AUDIO_LEVEL_INTERVAL)
+		return;
+
+	audio->last_level_time = cur_time;
+
+	audio_output_get_levels(audio->audio, 0, &levels);
+	get_max_audio_levels(&levels, &level, &peak);
+
+	calldata_setfloat(&data, "level", level);
+	calldata_setfloat(&data, "peak", peak);
+
+	signal_handler_signal(obs->signals, "master_volume_level", &data);
+
+	calldata_free(&data);
+}
+
 void *obs_video_thread(void *param)
 {
 	uint64_t last_time = 0;
@@ -431,6 +457,7 @@ void *obs_video_thread(void *param)
 		uint64_t cur_time = video_gettime(obs->video.video);
 
 		last_time = tick_sources(cur_time, last_time);
+		signal_master_levels(cur_time);
 
 		render_displays();
 
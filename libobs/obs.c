@@ -474,6 +474,7 @@ static const char *obs_signals[] = {
 
 	"void channel_change(int channel, in out ptr source, ptr prev_source)",
 	"void master_volume(in out float volume)",
+	"void master_volume_level(float level, float peak)",
 
 	NULL
 };
@@ -1026,6 +1027,11 @@ float obs_get_present_volume(void)
 	return obs ? obs->audio.present_volume : 0.0f;
 }
 
+void obs_get_audio_levels(struct audio_levels *levels)
+{
+	audio_output_get_levels(obs ? obs->audio.audio : NULL, 0, levels);
+}
+
 /* ensures that names are never blank */
 static inline char *dup_name(const char *name)
 {
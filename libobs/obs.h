@@ -172,6 +172,59 @@ struct source_frame {
 	bool                flip;
 };
 
+/** How a video encoder drops frames when its input queue is full */
+enum obs_encoder_drop_policy {
+	/** Drop the oldest queued frame to make room (lowest latency) */
+	OBS_ENCODER_DROP_OLDEST,
+
+	/** Drop the new frame */
+	OBS_ENCODER_DROP_NEWEST,
+};
+
+/** Number of buckets in the encode time histogram of obs_encoder_stats */
+#define OBS_ENCODER_TIME_BUCKETS 8
+
+/** Encoder statistics, see obs_encoder_get_stats */
+struct obs_encoder_stats {
+	uint64_t            frames_received; /**< Frames given to the encoder */
+	uint64_t            frames_dropped;  /**< Frames dropped from queue */
+
+	uint32_t            queue_depth;     /**< Frames currently queued */
+	uint32_t            queue_peak;      /**< Most frames ever queued */
+	uint32_t            queue_size;      /**< Maximum frames queued */
+
+	uint64_t            frames_encoded;  /**< Frames passed to encode */
+	uint64_t            packets_output;  /**< Packets output by encode */
+	uint64_t            bytes_output;    /**< Total size of the packets */
+	uint64_t            keyframes;       /**< Keyframes output */
+
+	/**
+	 * Frames that have been encoded but have not had a packet output yet,
+	 * which is how many frames the encoder is buffering (lookahead)
+	 */
+	uint32_t            frames_delayed;
+
+	/** Packets between the last two keyframes */
+	uint32_t            keyframe_interval;
+
+	uint64_t            bytes_per_sec;   /**< Output over the last second */
+	uint32_t            packets_per_sec; /**< Output over the last second */
+
+	uint64_t            encode_time_total_ns; /**< Time spent in encode */
+	uint64_t            encode_time_max_ns;   /**< Slowest encode call */
+
+	/** Encode calls that took longer than the frame's duration */
+	uint64_t            slow_frames;
+
+	/**
+	 * Encode call durations.  The first bucket counts calls that took
+	 * less than 1 millisecond, each following bucket doubles the limit of
+	 * the previous one, and the last bucket counts calls of 64
+	 * milliseconds or more.
+	 */
+	uint64_t            encode_time_hist[OBS_ENCODER_TIME_BUCKETS];
+};
+
 /* ------------------------------------------------------------------------- */
 /* OBS context */
 
@@ -357,6 +410,13 @@ EXPORT float obs_get_master_volume(void);
 /** Gets the master presentation volume */
 EXPORT float obs_get_present_volume(void);
 
+/**
+ * Gets the peak and RMS levels of the master mix over the last audio tick.
+ * The "master_volume_level" signal is also periodically emitted with the
+ * highest values of all channels.
+ */
+EXPORT void obs_get_audio_levels(struct audio_levels *levels);
+
 
 /* ------------------------------------------------------------------------- */
 /* View context */
@@ -528,6 +588,23 @@ EXPORT float obs_source_getvolume(obs_source_t source);
 /** Gets the presentation volume for a source */
 EXPORT float obs_source_get_present_volume(obs_source_t source);
 
+/**
+ * Sets which mixes (tracks) the audio of a source is mixed in to, as a mask
+ * of (1 << mix_idx) bits.  By default sources are only in the first mix.
+ */
+EXPORT void obs_source_set_audio_mixers(obs_source_t source, uint32_t mixers);
+
+/** Gets the mixes the audio of a source is mixed in to */
+EXPORT uint32_t obs_source_get_audio_mixers(obs_source_t source);
+
+/**
+ * Gets the peak and RMS levels of the audio a source output over the last
+ * audio tick.  The "volume_level" signal is also periodically emitted with
+ * the highest values of all channels.
+ */
+EXPORT void obs_source_get_audio_levels(obs_source_t source,
+		struct audio_levels *levels);
+
 /** Sets the audio sync offset (in nanoseconds) for a source */
 EXPORT void obs_source_set_sync_offset(obs_source_t source, int64_t offset);
 
@@ -853,10 +930,29 @@ EXPORT obs_properties_t obs_encoder_properties(obs_encoder_t encoder,
 
 /**
  * Updates the settings of the encoder context.  Usually used for changing
- * bitrate while active
+ * bitrate while active, in which case the update is applied on the encoding
+ * thread before the next frame.
  */
 EXPORT void obs_encoder_update(obs_encoder_t encoder, obs_data_t settings);
 
+/**
+ * Temporarily changes settings of an active encoder (such as the bitrate
+ * when a stream is congested), without storing them in the encoder's
+ * settings.  The changes are applied on the encoding thread before the next
+ * frame, and last until the encoder stops or its settings are updated.
+ *
+ * @return  false if the encoder isn't active, in which case nothing is done
+ */
+EXPORT bool obs_encoder_update_live(obs_encoder_t encoder,
+		obs_data_t settings);
+
+/**
+ * Returns whether the encoder is active (encoding for at least one output).
+ * Encoders can use this in their update callback to tell a live update on
+ * the encoding thread apart from an update while idle.
+ */
+EXPORT bool obs_encoder_active(obs_encoder_t encoder);
+
 /** Gets extra data (headers) associated with this context */
 EXPORT bool obs_encoder_get_extra_data(obs_encoder_t encoder,
 		uint8_t **extra_data, size_t *size);
@@ -870,6 +966,31 @@ EXPORT void obs_encoder_set_video(obs_encoder_t encoder, video_t video);
 /** Sets the audio output context to be used with this encoder */
 EXPORT void obs_encoder_set_audio(obs_encoder_t encoder, audio_t audio);
 
+/**
+ * Sets which mix (track) of the audio output an audio encoder encodes.  Can
+ * only be changed while the encoder is not active.
+ */
+EXPORT void obs_encoder_set_mixer(obs_encoder_t encoder, size_t mixer_idx);
+
+/** Gets the mix of the audio output an audio encoder encodes */
+EXPORT size_t obs_encoder_get_mixer(obs_encoder_t encoder);
+
+/**
+ * Sets the size of a video encoder's input queue, and what to drop when the
+ * encoder falls behind and the queue is full.  Video encoders encode on their
+ * own thread, the video output only queues frames for them.  Can only be
+ * changed while the encoder is not active.
+ */
+EXPORT void obs_encoder_set_queue(obs_encoder_t encoder, size_t size,
+		enum obs_encoder_drop_policy policy);
+
+/**
+ * Gets the statistics of an encoder.  Statistics are reset each time the
+ * encoder starts.
+ */
+EXPORT void obs_encoder_get_stats(obs_encoder_t encoder,
+		struct obs_encoder_stats *stats);
+
 /**
  * Returns the video output context used with this encoder, or NULL if not
  * a video context
@@ -882,10 +1003,30 @@ EXPORT video_t obs_encoder_video(obs_encoder_t encoder);
  */
 EXPORT audio_t obs_encoder_audio(obs_encoder_t encoder);
 
-/** Duplicates an encoder packet */
+/**
+ * Allocates shared data for an encoder packet with a single reference.  The
+ * data is aligned like bmalloc memory, and can be written to until the
+ * packet is first referenced elsewhere.
+ */
+EXPORT void obs_alloc_encoder_packet(struct encoder_packet *packet,
+		size_t size);
+
+/**
+ * Adds a reference to the data of an encoder packet, copying it into shared
+ * data first if it is not already shared.  Packets passed to encoder
+ * callbacks are always shared, so this does not copy them.
+ */
+EXPORT void obs_ref_encoder_packet(struct encoder_packet *dst,
+		const struct encoder_packet *src);
+
+/** Releases a reference to the data of an encoder packet */
+EXPORT void obs_release_encoder_packet(struct encoder_packet *packet);
+
+/** Same as obs_ref_encoder_packet */
 EXPORT void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 		const struct encoder_packet *src);
 
+/** Same as obs_release_encoder_packet */
 EXPORT void obs_free_encoder_packet(struct encoder_packet *packet);
 
 
@@ -236,6 +236,7 @@ bool OBSBasic::InitBasicConfigDefaults()
 	config_set_default_string(basicConfig, "Audio", "ChannelSetup",
 			"Stereo");
 	config_set_default_uint  (basicConfig, "Audio", "BufferingTime", 1000);
+	config_set_default_uint  (basicConfig, "Audio", "TickFrames", 0);
 
 	config_set_default_string(basicConfig, "Audio", "DesktopDevice1",
 			hasDesktopAudio ? "default" : "disabled");
@@ -616,6 +617,8 @@ bool OBSBasic::ResetAudio()
 		ai.speakers = SPEAKERS_STEREO;
 
 	ai.buffer_ms = config_get_uint(basicConfig, "Audio", "BufferingTime");
+	ai.tick_frames = (uint32_t)config_get_uint(basicConfig, "Audio",
+			"TickFrames");
 
 	return obs_reset_audio(&ai);
 }
@@ -130,10 +130,35 @@ static uint32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 static int32_t last_time = 0;
 #endif
 
+size_t flv_packet_prefix(struct encoder_packet *packet, bool is_header,
+		uint8_t prefix[FLV_MAX_PREFIX_SIZE])
+{
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		int64_t  offset = packet->pts - packet->dts;
+		uint32_t cts    = get_ms_time(packet, offset);
+
+		prefix[0] = packet->keyframe ? 0x17 : 0x27;
+		prefix[1] = is_header ? 0 : 1;
+		prefix[2] = (uint8_t)(cts >> 16);
+		prefix[3] = (uint8_t)(cts >> 8);
+		prefix[4] = (uint8_t)cts;
+		return 5;
+	}
+
+	prefix[0] = 0xaf;
+	prefix[1] = is_header ? 0 : 1;
+	return 2;
+}
+
+uint32_t flv_packet_time(struct encoder_packet *packet)
+{
+	return get_ms_time(packet, packet->dts) & 0x7FFFFFFF;
+}
+
 static void flv_video(struct serializer *s, struct encoder_packet *packet,
 		bool is_header)
 {
-	int64_t offset  = packet->pts - packet->dts;
+	uint8_t prefix[FLV_MAX_PREFIX_SIZE];
 	int32_t time_ms = get_ms_time(packet, packet->dts);
 
 	if (!packet->data || !packet->size)
@@ -156,9 +181,7 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 	s_wb24(s, 0);
 
 	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
+	s_write(s, prefix, flv_packet_prefix(packet, is_header, prefix));
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesnt count) */
@@ -168,6 +191,7 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 		bool is_header)
 {
+	uint8_t prefix[FLV_MAX_PREFIX_SIZE];
 	int32_t time_ms = get_ms_time(packet, packet->dts);
 
 	if (!packet->data || !packet->size)
@@ -190,8 +214,7 @@ static void flv_audio(struct serializer *s, struct encoder_packet *packet,
 	s_wb24(s, 0);
 
 	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
+	s_write(s, prefix, flv_packet_prefix(packet, is_header, prefix));
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesnt count) */
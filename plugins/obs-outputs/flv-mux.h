@@ -22,3 +22,13 @@
 extern void flv_meta_data(obs_output_t context, uint8_t **output, size_t *size);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
+
+#define FLV_MAX_PREFIX_SIZE 5
+
+/* writes the bytes of the FLV tag data that come before the packet data,
+ * returns the number of bytes written */
+extern size_t flv_packet_prefix(struct encoder_packet *packet, bool is_header,
+		uint8_t prefix[FLV_MAX_PREFIX_SIZE]);
+
+/* returns the FLV/RTMP timestamp of the packet in milliseconds */
+extern uint32_t flv_packet_time(struct encoder_packet *packet);
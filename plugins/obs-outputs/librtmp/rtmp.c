@@ -136,6 +136,22 @@ static void HandleClientBW(RTMP *r, const RTMPPacket *packet);
 static int ReadN(RTMP *r, char *buffer, int n);
 static int WriteN(RTMP *r, const char *buffer, int n);
 
+#ifdef _WIN32
+typedef WSABUF RTMPIOVec;
+#define IOV_SET(v, p, n)	((v).buf = (char *)(p), (v).len = (ULONG)(n))
+#define IOV_BASE(v)	((v).buf)
+#define IOV_LEN(v)	((int)(v).len)
+#else
+typedef struct iovec RTMPIOVec;
+#define IOV_SET(v, p, n)	((v).iov_base = (void *)(p), (v).iov_len = (size_t)(n))
+#define IOV_BASE(v)	((char *)(v).iov_base)
+#define IOV_LEN(v)	((int)(v).iov_len)
+#endif
+
+#define RTMP_MAX_IOV	64
+
+static int WriteV(RTMP *r, RTMPIOVec *iov, int count);
+
 static void DecodeTEA(AVal *key, AVal *text);
 
 static int HTTP_Post(RTMP *r, RTMPTCmd cmd, const char *buf, int len);
@@ -1835,6 +1851,54 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+/* writes all of the buffers directly to the socket, for plain TCP only */
+static int
+WriteV(RTMP *r, RTMPIOVec *iov, int count)
+{
+    while (count > 0)
+    {
+        int nBytes;
+#ifdef _WIN32
+        DWORD sent = 0;
+        if (WSASend(r->m_sb.sb_socket, iov, count, &sent, 0, NULL, NULL) == 0)
+            nBytes = (int)sent;
+        else
+            nBytes = -1;
+#else
+        nBytes = (int)writev(r->m_sb.sb_socket, iov, count);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* skip past what was sent, the last buffer may be partially sent */
+        while (count > 0 && nBytes >= IOV_LEN(*iov))
+        {
+            nBytes -= IOV_LEN(*iov);
+            iov++;
+            count--;
+        }
+
+        if (count > 0 && nBytes)
+            IOV_SET(*iov, IOV_BASE(*iov) + nBytes, IOV_LEN(*iov) - nBytes);
+    }
+
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -4262,18 +4326,20 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* works out the header type of a packet from the previous packet sent on its
+ * channel, and encodes its chunk header so that it ends at hend, with up to
+ * RTMP_MAX_HEADER_SIZE bytes free before it.  the start and size of the
+ * header are returned in header and hSize, the size of the extended chunk
+ * stream id in cSize, and the first header byte in c. */
+static int
+EncodePacketHeader(RTMP *r, RTMPPacket *packet, char *hend, char **header,
+                   int *hSize, int *cSize, char *c)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
-    int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *hptr;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4314,56 +4380,46 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     }
 
     nSize = packetSize[packet->m_headerType];
-    hSize = nSize;
-    cSize = 0;
+    *header = hend - nSize;
+    *hSize = nSize;
+    *cSize = 0;
     t = packet->m_nTimeStamp - last;
 
-    if (packet->m_body)
-    {
-        header = packet->m_body - nSize;
-        hend = packet->m_body;
-    }
-    else
-    {
-        header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
-    }
-
     if (packet->m_nChannel > 319)
-        cSize = 2;
+        *cSize = 2;
     else if (packet->m_nChannel > 63)
-        cSize = 1;
-    if (cSize)
+        *cSize = 1;
+    if (*cSize)
     {
-        header -= cSize;
-        hSize += cSize;
+        *header -= *cSize;
+        *hSize += *cSize;
     }
 
     if (nSize > 1 && t >= 0xffffff)
     {
-        header -= 4;
-        hSize += 4;
+        *header -= 4;
+        *hSize += 4;
     }
 
-    hptr = header;
-    c = packet->m_headerType << 6;
-    switch (cSize)
+    hptr = *header;
+    *c = packet->m_headerType << 6;
+    switch (*cSize)
     {
     case 0:
-        c |= packet->m_nChannel;
+        *c |= packet->m_nChannel;
         break;
     case 1:
         break;
     case 2:
-        c |= 1;
+        *c |= 1;
         break;
     }
-    *hptr++ = c;
-    if (cSize)
+    *hptr++ = *c;
+    if (*cSize)
     {
         int tmp = packet->m_nChannel - 64;
         *hptr++ = tmp & 0xff;
-        if (cSize == 2)
+        if (*cSize == 2)
             *hptr++ = tmp >> 8;
     }
 
@@ -4384,6 +4440,27 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    return TRUE;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    if (packet->m_body)
+        hend = packet->m_body;
+    else
+        hend = hbuf + sizeof(hbuf);
+
+    if (!EncodePacketHeader(r, packet, hend, &header, &hSize, &cSize, &c))
+        return FALSE;
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -4479,6 +4556,137 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     return TRUE;
 }
 
+/* copies the body in to a single buffer and sends it with RTMP_SendPacket,
+ * for connections that can't be written to directly */
+static int
+SendPacketBufsCopy(RTMP *r, RTMPPacket *packet, const RTMPBuf *bufs, int count,
+                   int bodySize)
+{
+    char *enc;
+    int i, ret;
+
+    if (!RTMPPacket_Alloc(packet, bodySize))
+        return FALSE;
+
+    enc = packet->m_body;
+    for (i = 0; i < count; i++)
+    {
+        memcpy(enc, bufs[i].b_data, bufs[i].b_size);
+        enc += bufs[i].b_size;
+    }
+
+    packet->m_nBodySize = bodySize;
+    ret = RTMP_SendPacket(r, packet, FALSE);
+    RTMPPacket_Free(packet);
+    return ret;
+}
+
+/* sends a packet whose body is split across several buffers.  the body is
+ * not copied: the chunk headers are written to a small buffer, and sent
+ * along with the pieces of the body straight from the caller's buffers with
+ * writev/WSASend.  packet->m_body must be NULL, and the body size is set from
+ * the buffers. */
+int
+RTMP_SendPacketBufs(RTMP *r, RTMPPacket *packet, const RTMPBuf *bufs, int count)
+{
+    int nSize, hSize, cSize, bodySize = 0;
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char cbuf[3];
+    RTMPIOVec iov[RTMP_MAX_IOV];
+    int iovCount = 0;
+    int buf = 0, bufOffset = 0, i;
+
+    for (i = 0; i < count; i++)
+        bodySize += bufs[i].b_size;
+
+    if ((r->Link.protocol & RTMP_FEATURE_HTTP) || r->m_bCustomSend
+#ifdef CRYPTO
+            || r->Link.rc4keyOut || r->m_sb.sb_ssl
+#endif
+       )
+        return SendPacketBufsCopy(r, packet, bufs, count, bodySize);
+
+    packet->m_body = NULL;
+    packet->m_nBodySize = bodySize;
+
+    if (!EncodePacketHeader(r, packet, hbuf + sizeof(hbuf), &header, &hSize,
+                            &cSize, &c))
+        return FALSE;
+
+    /* every chunk after the first starts with the same small header */
+    cbuf[0] = (0xc0 | c);
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        cbuf[1] = tmp & 0xff;
+        if (cSize == 2)
+            cbuf[2] = tmp >> 8;
+    }
+
+    RTMP_Log(RTMP_LOGDEBUG2, "%s: fd=%d, size=%d", __FUNCTION__, r->m_sb.sb_socket,
+             bodySize);
+
+    IOV_SET(iov[iovCount], header, hSize);
+    iovCount++;
+
+    nSize = bodySize;
+    while (nSize > 0)
+    {
+        int chunkLeft = nSize < r->m_outChunkSize ? nSize : r->m_outChunkSize;
+        nSize -= chunkLeft;
+
+        /* a chunk may span more than one buffer */
+        while (chunkLeft > 0)
+        {
+            int n = bufs[buf].b_size - bufOffset;
+            if (n > chunkLeft)
+                n = chunkLeft;
+
+            if (n > 0)
+            {
+                if (iovCount == RTMP_MAX_IOV)
+                {
+                    if (!WriteV(r, iov, iovCount))
+                        return FALSE;
+                    iovCount = 0;
+                }
+
+                IOV_SET(iov[iovCount], bufs[buf].b_data + bufOffset, n);
+                iovCount++;
+            }
+
+            bufOffset += n;
+            chunkLeft -= n;
+            if (bufOffset == bufs[buf].b_size)
+            {
+                buf++;
+                bufOffset = 0;
+            }
+        }
+
+        if (nSize > 0)
+        {
+            if (iovCount == RTMP_MAX_IOV)
+            {
+                if (!WriteV(r, iov, iovCount))
+                    return FALSE;
+                iovCount = 0;
+            }
+
+            IOV_SET(iov[iovCount], cbuf, 1 + cSize);
+            iovCount++;
+        }
+    }
+
+    if (!WriteV(r, iov, iovCount))
+        return FALSE;
+
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    return TRUE;
+}
+
 int
 RTMP_Serve(RTMP *r)
 {
@@ -137,6 +137,13 @@ extern "C"
         char *m_body;
     } RTMPPacket;
 
+    /* a piece of a packet body, see RTMP_SendPacketBufs */
+    typedef struct RTMPBuf
+    {
+        const char *b_data;
+        int b_size;
+    } RTMPBuf;
+
     typedef struct RTMPSockBuf
     {
         SOCKET sb_socket;
@@ -356,6 +363,8 @@ extern "C"
 
     int RTMP_ReadPacket(RTMP *r, RTMPPacket *packet);
     int RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue);
+    int RTMP_SendPacketBufs(RTMP *r, RTMPPacket *packet, const RTMPBuf *bufs,
+                            int count);
     int RTMP_SendChunk(RTMP *r, RTMPChunk *chunk);
     int RTMP_IsConnected(RTMP *r);
     SOCKET RTMP_Socket(RTMP *r);
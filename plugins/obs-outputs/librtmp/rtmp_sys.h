@@ -60,6 +60,7 @@
 #else /* !_WIN32 */
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/times.h>
 #include <netdb.h>
 #include <unistd.h>
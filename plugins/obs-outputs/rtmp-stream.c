@@ -19,22 +19,80 @@
 #include <obs-avc.h>
 #include <util/platform.h>
 #include <util/circlebuf.h>
+#include <util/darray.h>
 #include <util/dstr.h>
 #include <util/threading.h>
 #include "librtmp/rtmp.h"
 #include "librtmp/log.h"
 #include "flv-mux.h"
 
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#endif
+
 //#define FILE_TEST
 //#define TEST_FRAMEDROPS
 
+/* adaptive bitrate: the send buffer is checked once per interval.  when
+ * more than (drop threshold / CONGESTED_DIV) is buffered, the bitrate is
+ * lowered right away.  when less than (drop threshold / CLEAR_DIV) has been
+ * buffered for STABLE_INTERVALS in a row, it's raised back up in small
+ * steps.  frames are still dropped if the buffer reaches the drop threshold
+ * before the encoder has caught up. */
+#define ABR_INTERVAL_NS          1000000000ULL
+#define ABR_CONGESTED_DIV        4
+#define ABR_CLEAR_DIV            20
+#define ABR_STABLE_INTERVALS     10
+#define ABR_COOLDOWN_INTERVALS   3
+#define ABR_DECREASE_FACTOR      0.75
+#define ABR_THROUGHPUT_FACTOR    0.9
+#define ABR_INCREASE_FACTOR      0.05
+#define ABR_MIN_FACTOR           0.25
+
+#define NET_STATS_INTERVAL_NS    1000000000ULL
+
+/* while reconnecting, at most this much is kept queued */
+#define RECONNECT_MAX_BUFFER_USEC 10000000LL
+
+/* network statistics, sampled by the send thread */
+struct net_stats {
+	uint64_t         bytes_sent;
+	int              throughput_kbps;
+
+	/* from TCP_INFO, only available on linux */
+	bool             tcp_info_valid;
+	uint32_t         rtt_us;
+	uint32_t         rtt_var_us;
+	uint32_t         cwnd;
+	uint32_t         retransmits;
+	uint32_t         total_retrans;
+	int              unacked_bytes;
+	int              notsent_bytes;
+};
+
+struct rtmp_multi;
+
 struct rtmp_stream {
 	obs_output_t     output;
 
+	/* the multi-destination output this stream is a destination of, or
+	 * NULL if the stream is an output of its own.  destinations only
+	 * queue packets while capturing (locked by packets_mutex) */
+	struct rtmp_multi *multi;
+	bool             capturing;
+
 	pthread_mutex_t  packets_mutex;
 	struct circlebuf packets;
 
-	bool             connecting;
+	/* set when the threads are started, and only cleared once they have
+	 * been joined by rtmp_stream_stop, they never detach themselves */
+	bool             connect_thread_active;
 	pthread_t        connect_thread;
 
 	bool             active;
@@ -46,12 +104,47 @@ struct rtmp_stream {
 	struct dstr      path, key;
 	struct dstr      username, password;
 
+	/* keeps the socket's buffers small, so that data waits in the packet
+	 * queue (where it can be dropped) rather than in the kernel */
+	bool             low_latency;
+
+	/* reconnect variables */
+	bool             reconnect;
+	bool             reconnecting;
+	int              retry_delay_ms;
+	int              max_retries;
+	int              reconnects;
+	uint64_t         total_outage_ms;
+	uint64_t         max_outage_ms;
+
 	/* frame drop variables */
 	int64_t          drop_threshold_usec;
 	int64_t          min_drop_dts_usec;
 	int              min_priority;
 
 	int64_t          last_dts_usec;
+	uint64_t         dropped_frames;
+	size_t           buffered_bytes;
+
+	/* adaptive bitrate variables */
+	bool             adaptive_bitrate;
+	int              orig_bitrate;
+	int              orig_buffer_size;
+	int              cur_bitrate;
+	int              min_bitrate;
+	int              lowest_bitrate;
+	int              stable_intervals;
+	int              cooldown_intervals;
+	int              bitrate_decreases;
+	int              bitrate_increases;
+	uint64_t         last_check_ns;
+	uint64_t         sent_bytes;
+	uint64_t         last_sent_bytes;
+
+	/* network statistics (locked by packets_mutex) */
+	struct net_stats net_stats;
+	uint64_t         last_sample_ns;
+	uint64_t         last_sample_bytes;
 
 #ifdef FILE_TEST
 	FILE             *test;
@@ -80,17 +173,65 @@ static inline void free_packets(struct rtmp_stream *stream)
 	while (stream->packets.size) {
 		struct encoder_packet packet;
 		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-		obs_free_encoder_packet(&packet);
+		obs_release_encoder_packet(&packet);
+	}
+
+	stream->buffered_bytes = 0;
+}
+
+/* releases queued packets that are dropped rather than sent */
+static void drop_queued_packets(struct rtmp_stream *stream,
+		struct circlebuf *packets)
+{
+	while (packets->size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(packets, &packet, sizeof(packet));
+
+		if (packet.type == OBS_ENCODER_VIDEO)
+			stream->dropped_frames++;
+
+		stream->buffered_bytes -= packet.size;
+		obs_release_encoder_packet(&packet);
+	}
+}
+
+/* drops everything queued before the newest keyframe.  if no keyframe is
+ * queued, everything is dropped and incoming video is dropped until the
+ * next keyframe */
+static void trim_to_last_keyframe(struct rtmp_stream *stream)
+{
+	struct circlebuf new_buf        = {0};
+	bool             found_keyframe = false;
+
+	while (stream->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
+
+		if (packet.type == OBS_ENCODER_VIDEO && packet.keyframe) {
+			drop_queued_packets(stream, &new_buf);
+			found_keyframe = true;
+		}
+
+		circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+	}
+
+	circlebuf_free(&stream->packets);
+	stream->packets = new_buf;
+
+	if (!found_keyframe) {
+		drop_queued_packets(stream, &stream->packets);
+		stream->min_priority = OBS_NAL_PRIORITY_HIGHEST;
 	}
 }
 
 static void rtmp_stream_stop(void *data);
+static void get_network_stats_proc(void *data, calldata_t params);
 
 static void rtmp_stream_destroy(void *data)
 {
 	struct rtmp_stream *stream = data;
 
-	if (stream->active)
+	if (stream->active || stream->connect_thread_active)
 		rtmp_stream_stop(data);
 
 	if (stream) {
@@ -107,7 +248,7 @@ static void rtmp_stream_destroy(void *data)
 	}
 }
 
-static void *rtmp_stream_create(obs_data_t settings, obs_output_t output)
+static struct rtmp_stream *alloc_stream(obs_output_t output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
@@ -122,7 +263,6 @@ static void *rtmp_stream_create(obs_data_t settings, obs_output_t output)
 	if (os_event_init(&stream->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 
-	UNUSED_PARAMETER(settings);
 	return stream;
 
 fail:
@@ -130,10 +270,86 @@ fail:
 	return NULL;
 }
 
+static void *rtmp_stream_create(obs_data_t settings, obs_output_t output)
+{
+	struct rtmp_stream *stream = alloc_stream(output);
+	if (!stream)
+		return NULL;
+
+	proc_handler_add(obs_output_prochandler(output),
+			"void get_network_stats(out int bytes_sent, "
+			"out int throughput_kbps, out int buffer_ms, "
+			"out bool tcp_info_valid, out int rtt_us, "
+			"out int rtt_var_us, out int cwnd, out int retransmits, "
+			"out int total_retrans, out int unacked_bytes, "
+			"out int notsent_bytes, out int reconnects, "
+			"out int total_outage_ms, out int dropped_frames, "
+			"out int bitrate)",
+			get_network_stats_proc, stream);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+static void set_encoder_bitrate(struct rtmp_stream *stream, int bitrate)
+{
+	obs_encoder_t vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    settings = obs_data_create();
+
+	obs_data_setint(settings, "bitrate", bitrate);
+
+	/* keep the same buffer duration */
+	if (stream->orig_buffer_size)
+		obs_data_setint(settings, "buffer_size",
+				(long long)stream->orig_buffer_size * bitrate /
+				stream->orig_bitrate);
+
+	/* temporary, libobs reverts it once the encoder stops */
+	obs_encoder_update_live(vencoder, settings);
+	obs_data_release(settings);
+}
+
+static void log_bitrate_summary(struct rtmp_stream *stream)
+{
+	if (stream->adaptive_bitrate)
+		blog(LOG_INFO, "Adaptive bitrate: %d decrease(s), "
+		               "%d increase(s), lowest bitrate %d kbps",
+		               stream->bitrate_decreases,
+		               stream->bitrate_increases,
+		               stream->lowest_bitrate);
+
+	blog(LOG_INFO, "Dropped %llu video frame(s)",
+			(unsigned long long)stream->dropped_frames);
+
+	if (stream->reconnects)
+		blog(LOG_INFO, "Reconnected %d time(s), total outage %llu ms, "
+		               "longest outage %llu ms", stream->reconnects,
+		               (unsigned long long)stream->total_outage_ms,
+		               (unsigned long long)stream->max_outage_ms);
+
+	if (stream->net_stats.tcp_info_valid)
+		blog(LOG_INFO, "Network: sent %llu bytes, rtt %u ms, "
+		               "%u total retransmits",
+		               (unsigned long long)stream->net_stats.bytes_sent,
+		               stream->net_stats.rtt_us / 1000,
+		               stream->net_stats.total_retrans);
+}
+
+/* the stop signal can be handled on the stream's own threads, which can't
+ * join themselves.  they don't touch the stream after signalling */
+static void join_thread(pthread_t thread)
+{
+	void *ret;
+
+	if (pthread_equal(thread, pthread_self()))
+		pthread_detach(thread);
+	else
+		pthread_join(thread, &ret);
+}
+
 static void rtmp_stream_stop(void *data)
 {
 	struct rtmp_stream *stream = data;
-	void *ret;
 
 #ifdef FILE_TEST
 	fclose(stream->test);
@@ -141,14 +357,28 @@ static void rtmp_stream_stop(void *data)
 
 	os_event_signal(stream->stop_event);
 
-	if (stream->connecting)
-		pthread_join(stream->connect_thread, &ret);
+	if (stream->connect_thread_active) {
+		join_thread(stream->connect_thread);
+		stream->connect_thread_active = false;
+	}
 
 	if (stream->active) {
-		obs_output_end_data_capture(stream->output);
+		if (!stream->multi)
+			obs_output_end_data_capture(stream->output);
 		os_sem_post(stream->send_sem);
-		pthread_join(stream->send_thread, &ret);
+		join_thread(stream->send_thread);
+		stream->active = false;
 		RTMP_Close(&stream->rtmp);
+
+		log_bitrate_summary(stream);
+	}
+
+	/* the encoder reverts the lowered bitrate itself when it stops, but
+	 * if another output still uses it, restore the original now */
+	if (stream->adaptive_bitrate &&
+	    stream->cur_bitrate != stream->orig_bitrate) {
+		set_encoder_bitrate(stream, stream->orig_bitrate);
+		stream->cur_bitrate = stream->orig_bitrate;
 	}
 
 	os_event_reset(stream->stop_event);
@@ -177,6 +407,8 @@ static inline bool get_next_packet(struct rtmp_stream *stream,
 	if (stream->packets.size) {
 		circlebuf_pop_front(&stream->packets, packet,
 				sizeof(struct encoder_packet));
+		stream->sent_bytes     += packet->size;
+		stream->buffered_bytes -= packet->size;
 		new_packet = true;
 	}
 	pthread_mutex_unlock(&stream->packets_mutex);
@@ -184,22 +416,57 @@ static inline bool get_next_packet(struct rtmp_stream *stream,
 	return new_packet;
 }
 
-static int send_packet(struct rtmp_stream *stream,
+#ifdef FILE_TEST
+static int write_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet, bool is_header)
 {
 	uint8_t *data;
 	size_t  size;
-	int     ret = 0;
 
 	flv_packet_mux(packet, &data, &size, is_header);
-#ifdef FILE_TEST
 	fwrite(data, 1, size, stream->test);
+	bfree(data);
+	return (int)size;
+}
 #else
-	ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size);
+/* sends the FLV tag data as an RTMP packet straight from the packet data,
+ * rather than muxing a full FLV tag for RTMP_Write to parse and copy */
+static int write_packet(struct rtmp_stream *stream,
+		struct encoder_packet *packet, bool is_header)
+{
+	uint8_t    prefix[FLV_MAX_PREFIX_SIZE];
+	RTMPPacket rtmp_packet = {0};
+	RTMPBuf    bufs[2];
+
+	if (!packet->data || !packet->size)
+		return 0;
+
+	bufs[0].b_data = (const char*)prefix;
+	bufs[0].b_size = (int)flv_packet_prefix(packet, is_header, prefix);
+	bufs[1].b_data = (const char*)packet->data;
+	bufs[1].b_size = (int)packet->size;
+
+	rtmp_packet.m_nChannel    = 0x04;
+	rtmp_packet.m_nInfoField2 = stream->rtmp.m_stream_id;
+	rtmp_packet.m_nTimeStamp  = flv_packet_time(packet);
+	rtmp_packet.m_packetType  = (packet->type == OBS_ENCODER_VIDEO) ?
+		RTMP_PACKET_TYPE_VIDEO : RTMP_PACKET_TYPE_AUDIO;
+	rtmp_packet.m_headerType  = rtmp_packet.m_nTimeStamp ?
+		RTMP_PACKET_SIZE_MEDIUM : RTMP_PACKET_SIZE_LARGE;
+
+	if (!RTMP_SendPacketBufs(&stream->rtmp, &rtmp_packet, bufs, 2))
+		return -1;
+
+	return bufs[0].b_size + bufs[1].b_size;
+}
 #endif
-	bfree(data);
 
-	obs_free_encoder_packet(packet);
+static int send_packet(struct rtmp_stream *stream,
+		struct encoder_packet *packet, bool is_header)
+{
+	int ret = write_packet(stream, packet, is_header);
+
+	obs_release_encoder_packet(packet);
 	return ret;
 }
 
@@ -214,6 +481,155 @@ static bool send_remaining_packets(struct rtmp_stream *stream)
 	return true;
 }
 
+#ifdef __linux__
+static bool get_tcp_info(struct rtmp_stream *stream, struct net_stats *stats)
+{
+	int             sock = stream->rtmp.m_sb.sb_socket;
+	struct tcp_info info;
+	socklen_t       size = sizeof(info);
+	int             outq, notsent;
+
+	if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &size) != 0)
+		return false;
+
+	stats->rtt_us        = info.tcpi_rtt;
+	stats->rtt_var_us    = info.tcpi_rttvar;
+	stats->cwnd          = info.tcpi_snd_cwnd;
+	stats->retransmits   = info.tcpi_retransmits;
+	stats->total_retrans = info.tcpi_total_retrans;
+
+	/* bytes in the socket's send queue that have been sent but not
+	 * acknowledged, and that have not been sent at all */
+	if (ioctl(sock, SIOCOUTQ, &outq) == 0 &&
+	    ioctl(sock, SIOCOUTQNSD, &notsent) == 0) {
+		stats->unacked_bytes = outq - notsent;
+		stats->notsent_bytes = notsent;
+	}
+
+	return true;
+}
+#else
+static inline bool get_tcp_info(struct rtmp_stream *stream,
+		struct net_stats *stats)
+{
+	UNUSED_PARAMETER(stream);
+	UNUSED_PARAMETER(stats);
+	return false;
+}
+#endif
+
+static void sample_net_stats(struct rtmp_stream *stream)
+{
+	struct net_stats stats = {0};
+	uint64_t ts = os_gettime_ns();
+
+	if (ts - stream->last_sample_ns < NET_STATS_INTERVAL_NS)
+		return;
+
+	stats.tcp_info_valid = get_tcp_info(stream, &stats);
+
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	stats.bytes_sent = stream->sent_bytes;
+	if (stream->last_sample_ns)
+		stats.throughput_kbps = (int)(
+			(stats.bytes_sent - stream->last_sample_bytes) *
+			8 * 1000000ULL / (ts - stream->last_sample_ns));
+
+	stream->net_stats = stats;
+
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	stream->last_sample_ns    = ts;
+	stream->last_sample_bytes = stats.bytes_sent;
+}
+
+static int connect_rtmp(struct rtmp_stream *stream);
+static void init_socket(struct rtmp_stream *stream);
+static void send_headers(struct rtmp_stream *stream);
+static void destination_started(struct rtmp_stream *stream);
+static void destination_stopped(struct rtmp_stream *stream, int code);
+
+static inline void stream_stopped(struct rtmp_stream *stream, int code)
+{
+	if (stream->multi)
+		destination_stopped(stream, code);
+	else
+		obs_output_signal_stop(stream->output, code);
+}
+
+static inline void set_reconnecting(struct rtmp_stream *stream, bool active)
+{
+	pthread_mutex_lock(&stream->packets_mutex);
+
+	stream->reconnecting = active;
+	trim_to_last_keyframe(stream);
+
+	if (!active) {
+		/* don't drop what was kept, and restart the bitrate checks */
+		stream->min_drop_dts_usec = stream->last_dts_usec;
+		stream->last_check_ns     = 0;
+	}
+
+	pthread_mutex_unlock(&stream->packets_mutex);
+}
+
+static void record_outage(struct rtmp_stream *stream, uint64_t outage_ms)
+{
+	pthread_mutex_lock(&stream->packets_mutex);
+	stream->reconnects++;
+	stream->total_outage_ms += outage_ms;
+	if (outage_ms > stream->max_outage_ms)
+		stream->max_outage_ms = outage_ms;
+	pthread_mutex_unlock(&stream->packets_mutex);
+}
+
+/* reconnects after the connection is lost.  the encoders keep running, and
+ * packets keep being queued from the newest keyframe, so that streaming
+ * resumes at a keyframe with the same timestamps */
+static bool reconnect(struct rtmp_stream *stream)
+{
+	uint64_t start_ns = os_gettime_ns();
+	uint64_t outage_ms;
+
+	if (!stream->reconnect || os_event_try(stream->stop_event) != EAGAIN)
+		return false;
+
+	blog(LOG_WARNING, "Disconnected from %s, reconnecting",
+			stream->path.array);
+	set_reconnecting(stream, true);
+
+	for (int i = 1; i <= stream->max_retries; i++) {
+		os_event_timedwait(stream->stop_event,
+				(unsigned long)stream->retry_delay_ms);
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			break;
+
+		blog(LOG_INFO, "Reconnecting to %s (attempt %d of %d)...",
+				stream->path.array, i, stream->max_retries);
+
+		RTMP_Close(&stream->rtmp);
+		if (connect_rtmp(stream) != OBS_OUTPUT_SUCCESS)
+			continue;
+
+		init_socket(stream);
+		send_headers(stream);
+		set_reconnecting(stream, false);
+
+		outage_ms = (os_gettime_ns() - start_ns) / 1000000;
+		record_outage(stream, outage_ms);
+
+		blog(LOG_INFO, "Reconnected to %s after %llu ms",
+				stream->path.array,
+				(unsigned long long)outage_ms);
+		return true;
+	}
+
+	set_reconnecting(stream, false);
+	blog(LOG_WARNING, "Failed to reconnect to %s", stream->path.array);
+	return false;
+}
+
 static void *send_thread(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -227,9 +643,15 @@ static void *send_thread(void *data)
 		if (!get_next_packet(stream, &packet))
 			continue;
 		if (send_packet(stream, &packet, false) < 0) {
-			disconnected = true;
-			break;
+			if (!reconnect(stream)) {
+				disconnected = true;
+				break;
+			}
+
+			continue;
 		}
+
+		sample_net_stats(stream);
 	}
 
 	if (!disconnected && !send_remaining_packets(stream))
@@ -240,12 +662,11 @@ static void *send_thread(void *data)
 		free_packets(stream);
 	}
 
-	if (os_event_try(stream->stop_event) == EAGAIN) {
-		pthread_detach(stream->send_thread);
-		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
-	}
+	/* the thread is joined by rtmp_stream_stop, even when it stopped on
+	 * its own, so the stream can't be freed while it's still running */
+	if (os_event_try(stream->stop_event) == EAGAIN)
+		stream_stopped(stream, OBS_OUTPUT_DISCONNECTED);
 
-	stream->active = false;
 	return NULL;
 }
 
@@ -319,6 +740,14 @@ static inline bool reset_semaphore(struct rtmp_stream *stream)
 
 #define MIN_SENDBUF_SIZE 65535
 
+/* in low latency mode, the send buffer holds this much data at the stream's
+ * bitrate (it also has to hold data in flight that hasn't been
+ * acknowledged), and data is only queued in the socket when less than the
+ * not-sent low water mark is waiting to be sent */
+#define LOW_LATENCY_SENDBUF_MS   500
+#define LOW_LATENCY_NOTSENT_MS   50
+#define MIN_NOTSENT_LOWAT        16384
+
 static void adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
 {
 	int cur_sendbuf_size = new_size;
@@ -338,14 +767,65 @@ static void adjust_sndbuf_size(struct rtmp_stream *stream, int new_size)
 	}
 }
 
-static int init_send(struct rtmp_stream *stream)
+static inline int encoder_bitrate(obs_encoder_t encoder)
 {
-	int ret;
+	obs_data_t settings = obs_encoder_get_settings(encoder);
+	int        bitrate  = (int)obs_data_getint(settings, "bitrate");
 
-#if defined(_WIN32) && !defined(FILE_TEST)
-	adjust_sndbuf_size(stream, MIN_SENDBUF_SIZE);
+	obs_data_release(settings);
+	return bitrate;
+}
+
+static void set_low_latency_socket(struct rtmp_stream *stream)
+{
+	obs_encoder_t vencoder = obs_output_get_video_encoder(stream->output);
+	obs_encoder_t aencoder = obs_output_get_audio_encoder(stream->output);
+	int64_t bytes_per_sec;
+	int     sendbuf_size;
+	int     notsent_lowat = 0;
+
+	bytes_per_sec = (int64_t)(encoder_bitrate(vencoder) +
+			encoder_bitrate(aencoder)) * 1000 / 8;
+
+	sendbuf_size = (int)(bytes_per_sec * LOW_LATENCY_SENDBUF_MS / 1000);
+	if (sendbuf_size < MIN_SENDBUF_SIZE)
+		sendbuf_size = MIN_SENDBUF_SIZE;
+
+	setsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+			(const char*)&sendbuf_size, sizeof(sendbuf_size));
+
+#ifdef TCP_NOTSENT_LOWAT
+	notsent_lowat = (int)(bytes_per_sec * LOW_LATENCY_NOTSENT_MS / 1000);
+	if (notsent_lowat < MIN_NOTSENT_LOWAT)
+		notsent_lowat = MIN_NOTSENT_LOWAT;
+
+	setsockopt(stream->rtmp.m_sb.sb_socket, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+			(const char*)&notsent_lowat, sizeof(notsent_lowat));
 #endif
 
+	blog(LOG_INFO, "Low latency mode: send buffer %d bytes, not-sent low "
+	               "water mark %d bytes", sendbuf_size, notsent_lowat);
+}
+
+static void init_socket(struct rtmp_stream *stream)
+{
+#ifndef FILE_TEST
+	if (stream->low_latency)
+		set_low_latency_socket(stream);
+#ifdef _WIN32
+	else
+		adjust_sndbuf_size(stream, MIN_SENDBUF_SIZE);
+#endif
+#else
+	UNUSED_PARAMETER(stream);
+#endif
+}
+
+static int init_send(struct rtmp_stream *stream)
+{
+	int ret;
+
+	init_socket(stream);
 	reset_semaphore(stream);
 
 	ret = pthread_create(&stream->send_thread, NULL, send_thread, stream);
@@ -356,16 +836,23 @@ static int init_send(struct rtmp_stream *stream)
 
 	stream->active = true;
 	send_headers(stream);
-	obs_output_begin_data_capture(stream->output, 0);
+
+	if (stream->multi)
+		destination_started(stream);
+	else
+		obs_output_begin_data_capture(stream->output, 0);
 
 	return OBS_OUTPUT_SUCCESS;
 }
 
-static int try_connect(struct rtmp_stream *stream)
+static int connect_rtmp(struct rtmp_stream *stream)
 {
 #ifndef FILE_TEST
 	blog(LOG_INFO, "Connecting to RTMP URL %s...", stream->path.array);
 
+	/* the connection may have been used (and closed) before */
+	RTMP_Init(&stream->rtmp);
+
 	if (!RTMP_SetupURL2(&stream->rtmp, stream->path.array,
 				stream->key.array))
 		return OBS_OUTPUT_BAD_PATH;
@@ -380,7 +867,7 @@ static int try_connect(struct rtmp_stream *stream)
 
 	stream->rtmp.m_outChunkSize       = 4096;
 	stream->rtmp.m_bSendChunkSizeInfo = true;
-	stream->rtmp.m_bUseNagle          = true;
+	stream->rtmp.m_bUseNagle          = !stream->low_latency;
 
 	if (!RTMP_Connect(&stream->rtmp, NULL))
 		return OBS_OUTPUT_CONNECT_FAILED;
@@ -390,6 +877,15 @@ static int try_connect(struct rtmp_stream *stream)
 	blog(LOG_INFO, "Connection to %s successful", stream->path.array);
 #endif
 
+	return OBS_OUTPUT_SUCCESS;
+}
+
+static int try_connect(struct rtmp_stream *stream)
+{
+	int ret = connect_rtmp(stream);
+	if (ret != OBS_OUTPUT_SUCCESS)
+		return ret;
+
 	return init_send(stream);
 }
 
@@ -399,18 +895,80 @@ static void *connect_thread(void *data)
 	int ret = try_connect(stream);
 
 	if (ret != OBS_OUTPUT_SUCCESS) {
-		obs_output_signal_stop(stream->output, ret);
 		blog(LOG_INFO, "Connection to %s failed: %d",
 			stream->path.array, ret);
+		stream_stopped(stream, ret);
 	}
 
-	if (os_event_try(stream->stop_event) == EAGAIN)
-		pthread_detach(stream->connect_thread);
-
-	stream->connecting = false;
+	/* joined by rtmp_stream_stop, like the send thread */
 	return NULL;
 }
 
+static void init_adaptive_bitrate(struct rtmp_stream *stream)
+{
+	obs_encoder_t vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    settings = obs_encoder_get_settings(vencoder);
+
+	stream->orig_bitrate       = (int)obs_data_getint(settings, "bitrate");
+	stream->orig_buffer_size   =
+		(int)obs_data_getint(settings, "buffer_size");
+	stream->cur_bitrate        = stream->orig_bitrate;
+	stream->lowest_bitrate     = stream->orig_bitrate;
+	stream->min_bitrate        =
+		(int)(stream->orig_bitrate * ABR_MIN_FACTOR);
+	stream->stable_intervals   = 0;
+	stream->cooldown_intervals = 0;
+	stream->bitrate_decreases  = 0;
+	stream->bitrate_increases  = 0;
+	stream->last_check_ns      = 0;
+	stream->sent_bytes         = 0;
+	stream->last_sent_bytes    = 0;
+	stream->dropped_frames     = 0;
+
+	obs_data_release(settings);
+
+	/* encoders without a bitrate setting can't be adjusted */
+	if (stream->adaptive_bitrate && stream->orig_bitrate <= 0) {
+		blog(LOG_WARNING, "Adaptive bitrate disabled, the video "
+		                  "encoder has no bitrate");
+		stream->adaptive_bitrate = false;
+	}
+}
+
+static void load_settings(struct rtmp_stream *stream, obs_data_t settings)
+{
+	stream->drop_threshold_usec =
+		(int64_t)obs_data_getint(settings, "drop_threshold");
+	stream->adaptive_bitrate =
+		obs_data_getbool(settings, "adaptive_bitrate");
+	stream->low_latency =
+		obs_data_getbool(settings, "low_latency");
+	stream->reconnect =
+		obs_data_getbool(settings, "reconnect");
+	stream->retry_delay_ms =
+		(int)obs_data_getint(settings, "retry_delay") * 1000;
+	stream->max_retries =
+		(int)obs_data_getint(settings, "max_retries");
+}
+
+static bool start_stream(struct rtmp_stream *stream)
+{
+	init_adaptive_bitrate(stream);
+
+	stream->reconnecting    = false;
+	stream->reconnects      = 0;
+	stream->total_outage_ms = 0;
+	stream->max_outage_ms   = 0;
+
+	memset(&stream->net_stats, 0, sizeof(stream->net_stats));
+	stream->last_sample_ns    = 0;
+	stream->last_sample_bytes = 0;
+
+	stream->connect_thread_active = pthread_create(&stream->connect_thread,
+			NULL, connect_thread, stream) == 0;
+	return stream->connect_thread_active;
+}
+
 static bool rtmp_stream_start(void *data)
 {
 	struct rtmp_stream *stream = data;
@@ -422,17 +980,20 @@ static bool rtmp_stream_start(void *data)
 	if (!obs_output_initialize_encoders(stream->output, 0))
 		return false;
 
+	/* the threads of a stream that stopped on its own are still left to
+	 * be joined */
+	if (stream->active || stream->connect_thread_active)
+		rtmp_stream_stop(stream);
+
 	settings = obs_output_get_settings(stream->output);
 	dstr_copy(&stream->path,     obs_service_get_url(service));
 	dstr_copy(&stream->key,      obs_service_get_key(service));
 	dstr_copy(&stream->username, obs_service_get_username(service));
 	dstr_copy(&stream->password, obs_service_get_password(service));
-	stream->drop_threshold_usec =
-		(int64_t)obs_data_getint(settings, "drop_threshold");
+	load_settings(stream, settings);
 	obs_data_release(settings);
 
-	return pthread_create(&stream->connect_thread, NULL, connect_thread,
-			stream) == 0;
+	return start_stream(stream);
 }
 
 static inline bool add_packet(struct rtmp_stream *stream,
@@ -440,7 +1001,8 @@ static inline bool add_packet(struct rtmp_stream *stream,
 {
 	circlebuf_push_back(&stream->packets, packet,
 			sizeof(struct encoder_packet));
-	stream->last_dts_usec = packet->dts_usec;
+	stream->last_dts_usec   = packet->dts_usec;
+	stream->buffered_bytes += packet->size;
 	return true;
 }
 
@@ -449,14 +1011,53 @@ static inline size_t num_buffered_packets(struct rtmp_stream *stream)
 	return stream->packets.size / sizeof(struct encoder_packet);
 }
 
-static void drop_frames(struct rtmp_stream *stream)
+/* frames are dropped in passes, from the least to the most noticeable:
+ *
+ *  - disposable frames, which no other frames reference
+ *  - all frames up to the next keyframe, which freezes the picture until the
+ *    keyframe (or until the next incoming keyframe if none are buffered)
+ *  - all buffered video
+ *
+ * audio is always kept. */
+enum drop_pass {
+	DROP_DISPOSABLE,
+	DROP_UNTIL_KEYFRAME,
+	DROP_ALL,
+};
+
+static const char *drop_pass_names[] = {
+	"disposable frames",
+	"frames until the next keyframe",
+	"all video"
+};
+
+static inline bool should_drop(enum drop_pass pass,
+		const struct encoder_packet *packet, bool *found_keyframe)
 {
-	struct circlebuf new_buf            = {0};
-	int              drop_priority      = 0;
-	uint64_t         last_drop_dts_usec = 0;
+	if (packet->type == OBS_ENCODER_AUDIO)
+		return false;
 
-	blog(LOG_DEBUG, "Previous packet count: %d",
-			(int)num_buffered_packets(stream));
+	if (pass == DROP_DISPOSABLE)
+		return !packet->keyframe &&
+			packet->priority == OBS_NAL_PRIORITY_DISPOSABLE;
+
+	if (pass == DROP_UNTIL_KEYFRAME) {
+		if (packet->keyframe)
+			*found_keyframe = true;
+		return !*found_keyframe;
+	}
+
+	return true;
+}
+
+/* returns the number of bytes dropped */
+static size_t drop_packets(struct rtmp_stream *stream, enum drop_pass pass)
+{
+	struct circlebuf new_buf        = {0};
+	int              drop_priority  = 0;
+	bool             found_keyframe = false;
+	size_t           dropped_bytes  = 0;
+	size_t           dropped_frames = 0;
 
 	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
 
@@ -464,28 +1065,165 @@ static void drop_frames(struct rtmp_stream *stream)
 		struct encoder_packet packet;
 		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
 
-		last_drop_dts_usec = packet.dts_usec;
-
-		if (packet.type == OBS_ENCODER_AUDIO) {
+		if (!should_drop(pass, &packet, &found_keyframe)) {
 			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
+			continue;
+		}
 
-		} else {
-			if (drop_priority < packet.drop_priority)
-				drop_priority = packet.drop_priority;
+		if (drop_priority < packet.drop_priority)
+			drop_priority = packet.drop_priority;
 
-			obs_free_encoder_packet(&packet);
-		}
+		dropped_bytes += packet.size;
+		dropped_frames++;
+		obs_release_encoder_packet(&packet);
 	}
 
 	circlebuf_free(&stream->packets);
-	stream->packets           = new_buf;
-	stream->min_priority      = drop_priority;
-	stream->min_drop_dts_usec = last_drop_dts_usec;
+	stream->packets         = new_buf;
+	stream->buffered_bytes -= dropped_bytes;
+	stream->dropped_frames += dropped_frames;
+
+	/* frames after the dropped ones reference them, so incoming frames
+	 * have to be dropped as well until one of high enough priority */
+	if (pass == DROP_UNTIL_KEYFRAME && !found_keyframe && dropped_frames)
+		stream->min_priority = OBS_NAL_PRIORITY_HIGHEST;
+	else if (pass == DROP_ALL && drop_priority > stream->min_priority)
+		stream->min_priority = drop_priority;
+
+	if (dropped_frames)
+		blog(LOG_INFO, "Dropped %d frame(s): %s",
+				(int)dropped_frames, drop_pass_names[pass]);
+
+	return dropped_bytes;
+}
+
+static void drop_frames(struct rtmp_stream *stream,
+		int64_t buffer_duration_usec)
+{
+	int64_t target_usec = stream->drop_threshold_usec / 2;
+	size_t  target_bytes;
+	size_t  dropped_bytes = 0;
+
+	blog(LOG_DEBUG, "Previous packet count: %d",
+			(int)num_buffered_packets(stream));
+
+	/* drop enough data to bring the buffer down to half the threshold,
+	 * assuming it drains at the rate it's been filling up */
+	target_bytes = (size_t)((double)stream->buffered_bytes *
+		(double)(buffer_duration_usec - target_usec) /
+		(double)buffer_duration_usec);
+
+	for (int pass = DROP_DISPOSABLE; pass <= DROP_ALL; pass++) {
+		dropped_bytes += drop_packets(stream, (enum drop_pass)pass);
+		if (dropped_bytes >= target_bytes)
+			break;
+	}
+
+	stream->min_drop_dts_usec = stream->last_dts_usec;
 
 	blog(LOG_DEBUG, "New packet count: %d",
 			(int)num_buffered_packets(stream));
 }
 
+static inline int64_t get_buffer_duration(struct rtmp_stream *stream)
+{
+	struct encoder_packet first;
+
+	if (!stream->packets.size)
+		return 0;
+
+	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
+	return stream->last_dts_usec - first.dts_usec;
+}
+
+/* returns the new bitrate if it should be changed, 0 otherwise */
+static int check_bitrate(struct rtmp_stream *stream)
+{
+	int64_t  buffer_duration_usec = get_buffer_duration(stream);
+	uint64_t ts = os_gettime_ns();
+	uint64_t elapsed;
+	int      throughput;
+	int      new_bitrate = 0;
+
+	if (!stream->last_check_ns) {
+		stream->last_check_ns   = ts;
+		stream->last_sent_bytes = stream->sent_bytes;
+		return 0;
+	}
+
+	elapsed = ts - stream->last_check_ns;
+	if (elapsed < ABR_INTERVAL_NS)
+		return 0;
+
+	/* kbps of packet data taken by the send thread during the interval */
+	throughput = (int)((stream->sent_bytes - stream->last_sent_bytes) *
+			8 * 1000000ULL / elapsed);
+
+	stream->last_check_ns   = ts;
+	stream->last_sent_bytes = stream->sent_bytes;
+
+	/* give the encoder time to apply the last decrease before checking
+	 * again, frames already encoded are still at the previous bitrate */
+	if (stream->cooldown_intervals) {
+		stream->cooldown_intervals--;
+		return 0;
+	}
+
+	if (buffer_duration_usec >
+	    stream->drop_threshold_usec / ABR_CONGESTED_DIV) {
+		stream->stable_intervals = 0;
+
+		new_bitrate = (int)(stream->cur_bitrate * ABR_DECREASE_FACTOR);
+
+		/* if the connection is sending much less than that, go
+		 * straight down to what it can actually send */
+		if (throughput * ABR_THROUGHPUT_FACTOR < new_bitrate)
+			new_bitrate = (int)(throughput * ABR_THROUGHPUT_FACTOR);
+		if (new_bitrate < stream->min_bitrate)
+			new_bitrate = stream->min_bitrate;
+		if (new_bitrate >= stream->cur_bitrate)
+			return 0;
+
+		blog(LOG_INFO, "Congestion detected (%lld ms buffered, "
+		               "sending %d kbps, rtt %d ms), lowering "
+		               "bitrate from %d to %d kbps",
+		               (long long)(buffer_duration_usec / 1000),
+		               throughput,
+		               (int)(stream->net_stats.rtt_us / 1000),
+		               stream->cur_bitrate, new_bitrate);
+
+		stream->cooldown_intervals = ABR_COOLDOWN_INTERVALS;
+		stream->bitrate_decreases++;
+		if (new_bitrate < stream->lowest_bitrate)
+			stream->lowest_bitrate = new_bitrate;
+
+	} else if (buffer_duration_usec <
+	           stream->drop_threshold_usec / ABR_CLEAR_DIV) {
+		if (stream->cur_bitrate >= stream->orig_bitrate ||
+		    ++stream->stable_intervals < ABR_STABLE_INTERVALS)
+			return 0;
+
+		stream->stable_intervals = 0;
+
+		new_bitrate = stream->cur_bitrate +
+			(int)(stream->orig_bitrate * ABR_INCREASE_FACTOR);
+		if (new_bitrate > stream->orig_bitrate)
+			new_bitrate = stream->orig_bitrate;
+
+		blog(LOG_INFO, "Raising bitrate from %d to %d kbps",
+				stream->cur_bitrate, new_bitrate);
+
+		stream->bitrate_increases++;
+
+	} else {
+		stream->stable_intervals = 0;
+		return 0;
+	}
+
+	stream->cur_bitrate = new_bitrate;
+	return new_bitrate;
+}
+
 static void check_to_drop_frames(struct rtmp_stream *stream)
 {
 	struct encoder_packet first;
@@ -502,14 +1240,50 @@ static void check_to_drop_frames(struct rtmp_stream *stream)
 
 	/* if the amount of time stored in the buffered packets waiting to be
 	 * sent is higher than threshold, drop frames */
-	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
+	buffer_duration_usec = get_buffer_duration(stream);
 	if (buffer_duration_usec > stream->drop_threshold_usec) {
-		drop_frames(stream);
-		blog(LOG_INFO, "dropping %lld worth of frames",
-				buffer_duration_usec);
+		blog(LOG_INFO, "%lld ms buffered, dropping frames",
+				(long long)(buffer_duration_usec / 1000));
+		drop_frames(stream, buffer_duration_usec);
 	}
 }
 
+static void get_network_stats_proc(void *data, calldata_t params)
+{
+	struct rtmp_stream *stream = data;
+	struct net_stats   stats;
+	int64_t            buffer_duration_usec;
+	int                reconnects;
+	uint64_t           total_outage_ms;
+	uint64_t           dropped_frames;
+	int                bitrate;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	stats                = stream->net_stats;
+	buffer_duration_usec = get_buffer_duration(stream);
+	reconnects           = stream->reconnects;
+	total_outage_ms      = stream->total_outage_ms;
+	dropped_frames       = stream->dropped_frames;
+	bitrate              = stream->cur_bitrate;
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	calldata_setint(params, "bytes_sent", (long long)stats.bytes_sent);
+	calldata_setint(params, "throughput_kbps", stats.throughput_kbps);
+	calldata_setint(params, "buffer_ms", buffer_duration_usec / 1000);
+	calldata_setbool(params, "tcp_info_valid", stats.tcp_info_valid);
+	calldata_setint(params, "rtt_us", stats.rtt_us);
+	calldata_setint(params, "rtt_var_us", stats.rtt_var_us);
+	calldata_setint(params, "cwnd", stats.cwnd);
+	calldata_setint(params, "retransmits", stats.retransmits);
+	calldata_setint(params, "total_retrans", stats.total_retrans);
+	calldata_setint(params, "unacked_bytes", stats.unacked_bytes);
+	calldata_setint(params, "notsent_bytes", stats.notsent_bytes);
+	calldata_setint(params, "reconnects", reconnects);
+	calldata_setint(params, "total_outage_ms", (long long)total_outage_ms);
+	calldata_setint(params, "dropped_frames", (long long)dropped_frames);
+	calldata_setint(params, "bitrate", bitrate);
+}
+
 static bool add_video_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet)
 {
@@ -517,42 +1291,97 @@ static bool add_video_packet(struct rtmp_stream *stream,
 
 	/* if currently dropping frames, drop packets until it reaches the
 	 * desired priority */
-	if (packet->priority < stream->min_priority)
+	if (packet->priority < stream->min_priority) {
+		stream->dropped_frames++;
 		return false;
-	else
+	} else
 		stream->min_priority = 0;
 
 	return add_packet(stream, packet);
 }
 
-static void rtmp_stream_data(void *data, struct encoder_packet *packet)
+/* while reconnecting, only the newest keyframe and what follows it are kept
+ * (up to RECONNECT_MAX_BUFFER_USEC) so that sending resumes at a keyframe */
+static bool add_reconnect_packet(struct rtmp_stream *stream,
+		struct encoder_packet *packet)
 {
-	struct rtmp_stream    *stream = data;
-	struct encoder_packet new_packet;
-	bool                  added_packet;
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		if (packet->priority < stream->min_priority) {
+			stream->dropped_frames++;
+			return false;
+		}
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		obs_parse_avc_packet(&new_packet, packet);
-	else
-		obs_duplicate_encoder_packet(&new_packet, packet);
+		stream->min_priority = 0;
+	}
+
+	add_packet(stream, packet);
+
+	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe) {
+		trim_to_last_keyframe(stream);
+
+	} else if (get_buffer_duration(stream) > RECONNECT_MAX_BUFFER_USEC) {
+		drop_queued_packets(stream, &stream->packets);
+		stream->min_priority = OBS_NAL_PRIORITY_HIGHEST;
+	}
+
+	return true;
+}
+
+/* queues a packet to be sent, taking ownership of it */
+static void queue_packet(struct rtmp_stream *stream,
+		struct encoder_packet *packet)
+{
+	bool added_packet = false;
+	int  new_bitrate  = 0;
 
 	pthread_mutex_lock(&stream->packets_mutex);
 
-	added_packet = (packet->type == OBS_ENCODER_VIDEO) ?
-		add_video_packet(stream, &new_packet) :
-		add_packet(stream, &new_packet);
+	/* destinations only queue packets while they're connected */
+	if (stream->multi && !stream->capturing)
+		added_packet = false;
+	else if (stream->reconnecting)
+		added_packet = add_reconnect_packet(stream, packet);
+	else if (packet->type == OBS_ENCODER_VIDEO)
+		added_packet = add_video_packet(stream, packet);
+	else
+		added_packet = add_packet(stream, packet);
+
+	if (stream->adaptive_bitrate && !stream->reconnecting &&
+	    packet->type == OBS_ENCODER_VIDEO)
+		new_bitrate = check_bitrate(stream);
 
 	pthread_mutex_unlock(&stream->packets_mutex);
 
+	if (new_bitrate)
+		set_encoder_bitrate(stream, new_bitrate);
+
 	if (added_packet)
 		os_sem_post(stream->send_sem);
 	else
-		obs_free_encoder_packet(&new_packet);
+		obs_release_encoder_packet(packet);
+}
+
+static void rtmp_stream_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_stream    *stream = data;
+	struct encoder_packet new_packet;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_parse_avc_packet(&new_packet, packet);
+	else
+		obs_ref_encoder_packet(&new_packet, packet);
+
+	queue_packet(stream, &new_packet);
 }
 
 static void rtmp_stream_defaults(obs_data_t defaults)
 {
 	obs_data_set_default_int(defaults, "drop_threshold", 600000);
+	obs_data_set_default_bool(defaults, "adaptive_bitrate", false);
+	obs_data_set_default_bool(defaults, "low_latency", false);
+	obs_data_set_default_bool(defaults, "reconnect", true);
+	obs_data_set_default_int(defaults, "retry_delay", 2);
+	obs_data_set_default_int(defaults, "max_retries", 20);
 }
 
 static obs_properties_t rtmp_stream_properties(const char *locale)
@@ -566,6 +1395,14 @@ static obs_properties_t rtmp_stream_properties(const char *locale)
 			OBS_TEXT_DEFAULT);
 	obs_properties_add_text(props, "password", "Password",
 			OBS_TEXT_PASSWORD);
+	obs_properties_add_bool(props, "adaptive_bitrate",
+			"Lower bitrate automatically when congested");
+	obs_properties_add_bool(props, "low_latency", "Low latency mode");
+	obs_properties_add_bool(props, "reconnect", "Automatically reconnect");
+	obs_properties_add_int(props, "retry_delay",
+			"Reconnect delay (seconds)", 1, 60, 1);
+	obs_properties_add_int(props, "max_retries", "Maximum reconnects",
+			1, 10000, 1);
 	return props;
 }
 
@@ -583,3 +1420,346 @@ struct obs_output_info rtmp_output_info = {
 	.defaults       = rtmp_stream_defaults,
 	.properties     = rtmp_stream_properties
 };
+
+/* ------------------------------------------------------------------------- */
+
+/*
+ * Multi-destination output.  Sends the same encoded stream to several RTMP
+ * servers, each destination being an rtmp_stream with its own connection,
+ * send thread, frame dropping and reconnecting.  Each packet is parsed
+ * once into shared data, and destinations only queue a reference to it, so
+ * an extra destination costs its socket writes rather than another copy.
+ */
+
+struct rtmp_multi {
+	obs_output_t    output;
+
+	pthread_mutex_t mutex;
+	DARRAY(struct rtmp_stream*) destinations;
+
+	bool            capturing;
+	bool            stopping;
+	size_t          connected;
+	size_t          pending;
+};
+
+/* called by a destination once it has connected and sent its headers.  the
+ * first destination to connect starts capture, and destinations that
+ * connect later start sending at the next keyframe */
+static void destination_started(struct rtmp_stream *stream)
+{
+	struct rtmp_multi *multi = stream->multi;
+	bool              joining;
+	bool              begin_capture;
+
+	pthread_mutex_lock(&multi->mutex);
+	multi->pending--;
+	multi->connected++;
+	joining       = multi->capturing;
+	begin_capture = !joining && !multi->stopping;
+	if (begin_capture)
+		multi->capturing = true;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	stream->capturing = true;
+	if (joining)
+		stream->min_priority = OBS_NAL_PRIORITY_HIGHEST;
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	pthread_mutex_unlock(&multi->mutex);
+
+	/* rtmp_multi_stop joins the connect threads before ending capture,
+	 * so this can't race with it */
+	if (begin_capture)
+		obs_output_begin_data_capture(multi->output, 0);
+}
+
+/* called by a destination that failed to connect or lost its connection.
+ * the output only stops once it has no destinations left */
+static void destination_stopped(struct rtmp_stream *stream, int code)
+{
+	struct rtmp_multi *multi = stream->multi;
+	bool              was_connected;
+	bool              stop = false;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	was_connected     = stream->capturing;
+	stream->capturing = false;
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	pthread_mutex_lock(&multi->mutex);
+
+	if (was_connected)
+		multi->connected--;
+	else
+		multi->pending--;
+
+	if (!multi->stopping && !multi->connected && !multi->pending) {
+		if (multi->capturing)
+			code = OBS_OUTPUT_DISCONNECTED;
+
+		multi->capturing = false;
+		stop = true;
+	}
+
+	pthread_mutex_unlock(&multi->mutex);
+
+	if (stop)
+		obs_output_signal_stop(multi->output, code);
+}
+
+static const char *rtmp_multi_getname(const char *locale)
+{
+	/* TODO: locale stuff */
+	UNUSED_PARAMETER(locale);
+	return "RTMP Multi-Destination Stream";
+}
+
+static void rtmp_multi_stop(void *data)
+{
+	struct rtmp_multi *multi = data;
+	DARRAY(struct rtmp_stream*) destinations;
+	bool capturing;
+
+	da_init(destinations);
+
+	pthread_mutex_lock(&multi->mutex);
+	multi->stopping = true;
+	da_move(destinations, multi->destinations);
+	pthread_mutex_unlock(&multi->mutex);
+
+	for (size_t i = 0; i < destinations.num; i++) {
+		struct rtmp_stream *stream = destinations.array[i];
+
+		blog(LOG_INFO, "Stopping destination %s", stream->path.array);
+		rtmp_stream_stop(stream);
+		rtmp_stream_destroy(stream);
+	}
+
+	da_free(destinations);
+
+	pthread_mutex_lock(&multi->mutex);
+	capturing        = multi->capturing;
+	multi->capturing = false;
+	pthread_mutex_unlock(&multi->mutex);
+
+	if (capturing)
+		obs_output_end_data_capture(multi->output);
+}
+
+static void rtmp_multi_destroy(void *data)
+{
+	struct rtmp_multi *multi = data;
+
+	if (multi) {
+		if (multi->destinations.num)
+			rtmp_multi_stop(multi);
+
+		pthread_mutex_destroy(&multi->mutex);
+		bfree(multi);
+	}
+}
+
+static void get_destination_count_proc(void *data, calldata_t params)
+{
+	struct rtmp_multi *multi = data;
+
+	pthread_mutex_lock(&multi->mutex);
+	calldata_setint(params, "count", (long long)multi->destinations.num);
+	pthread_mutex_unlock(&multi->mutex);
+}
+
+static void get_destination_stats_proc(void *data, calldata_t params)
+{
+	struct rtmp_multi *multi = data;
+	size_t idx = (size_t)calldata_int(params, "index");
+
+	pthread_mutex_lock(&multi->mutex);
+
+	if (idx < multi->destinations.num) {
+		struct rtmp_stream *stream = multi->destinations.array[idx];
+		bool connected;
+
+		pthread_mutex_lock(&stream->packets_mutex);
+		connected = stream->capturing && !stream->reconnecting;
+		pthread_mutex_unlock(&stream->packets_mutex);
+
+		calldata_setstring(params, "url", stream->path.array);
+		calldata_setbool(params, "connected", connected);
+		get_network_stats_proc(stream, params);
+	}
+
+	pthread_mutex_unlock(&multi->mutex);
+}
+
+static void *rtmp_multi_create(obs_data_t settings, obs_output_t output)
+{
+	struct rtmp_multi *multi = bzalloc(sizeof(struct rtmp_multi));
+	multi->output = output;
+
+	if (pthread_mutex_init(&multi->mutex, NULL) != 0) {
+		bfree(multi);
+		return NULL;
+	}
+
+	proc_handler_add(obs_output_prochandler(output),
+			"void get_destination_count(out int count)",
+			get_destination_count_proc, multi);
+	proc_handler_add(obs_output_prochandler(output),
+			"void get_destination_stats(in int index, "
+			"out string url, out bool connected, "
+			"out int bytes_sent, out int throughput_kbps, "
+			"out int buffer_ms, out int dropped_frames, "
+			"out int reconnects)",
+			get_destination_stats_proc, multi);
+
+	UNUSED_PARAMETER(settings);
+	return multi;
+}
+
+static void add_destination(struct rtmp_multi *multi, obs_data_t settings,
+		obs_data_t destination)
+{
+	const char         *url = obs_data_getstring(destination, "url");
+	struct rtmp_stream *stream;
+
+	if (!url || !*url)
+		return;
+
+	stream = alloc_stream(multi->output);
+	if (!stream)
+		return;
+
+	stream->multi = multi;
+	dstr_copy(&stream->path,     url);
+	dstr_copy(&stream->key,      obs_data_getstring(destination, "key"));
+	dstr_copy(&stream->username,
+			obs_data_getstring(destination, "username"));
+	dstr_copy(&stream->password,
+			obs_data_getstring(destination, "password"));
+	load_settings(stream, settings);
+
+	/* the encoders are shared by all destinations, so one destination
+	 * can't lower the bitrate for everyone */
+	stream->adaptive_bitrate = false;
+
+	da_push_back(multi->destinations, &stream);
+}
+
+static bool rtmp_multi_start(void *data)
+{
+	struct rtmp_multi *multi = data;
+	obs_data_t        settings;
+	obs_data_array_t  array;
+	size_t            count;
+	size_t            started = 0;
+
+	if (!obs_output_can_begin_data_capture(multi->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(multi->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(multi->output);
+	array    = obs_data_getarray(settings, "destinations");
+	count    = obs_data_array_count(array);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t destination = obs_data_array_item(array, i);
+		add_destination(multi, settings, destination);
+		obs_data_release(destination);
+	}
+
+	obs_data_array_release(array);
+	obs_data_release(settings);
+
+	if (!multi->destinations.num) {
+		blog(LOG_WARNING, "rtmp_multi_start: No destinations");
+		return false;
+	}
+
+	pthread_mutex_lock(&multi->mutex);
+	multi->capturing = false;
+	multi->stopping  = false;
+	multi->connected = 0;
+	multi->pending   = multi->destinations.num;
+	pthread_mutex_unlock(&multi->mutex);
+
+	for (size_t i = 0; i < multi->destinations.num; i++) {
+		if (start_stream(multi->destinations.array[i])) {
+			started++;
+		} else {
+			pthread_mutex_lock(&multi->mutex);
+			multi->pending--;
+			pthread_mutex_unlock(&multi->mutex);
+		}
+	}
+
+	if (!started) {
+		rtmp_multi_stop(multi);
+		return false;
+	}
+
+	return true;
+}
+
+static void rtmp_multi_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi     *multi = data;
+	struct encoder_packet shared;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_parse_avc_packet_shared(&shared, packet);
+	else
+		obs_ref_encoder_packet(&shared, packet);
+
+	pthread_mutex_lock(&multi->mutex);
+
+	for (size_t i = 0; i < multi->destinations.num; i++) {
+		struct encoder_packet ref;
+
+		obs_ref_encoder_packet(&ref, &shared);
+		queue_packet(multi->destinations.array[i], &ref);
+	}
+
+	pthread_mutex_unlock(&multi->mutex);
+
+	obs_release_encoder_packet(&shared);
+}
+
+static void rtmp_multi_defaults(obs_data_t defaults)
+{
+	obs_data_set_default_int(defaults, "drop_threshold", 600000);
+	obs_data_set_default_bool(defaults, "low_latency", false);
+	obs_data_set_default_bool(defaults, "reconnect", true);
+	obs_data_set_default_int(defaults, "retry_delay", 2);
+	obs_data_set_default_int(defaults, "max_retries", 20);
+}
+
+static obs_properties_t rtmp_multi_properties(const char *locale)
+{
+	obs_properties_t props = obs_properties_create(locale);
+
+	/* TODO: locale.  destinations are set with the "destinations"
+	 * array, each item having "url", "key", "username" and "password" */
+	obs_properties_add_bool(props, "low_latency", "Low latency mode");
+	obs_properties_add_bool(props, "reconnect", "Automatically reconnect");
+	obs_properties_add_int(props, "retry_delay",
+			"Reconnect delay (seconds)", 1, 60, 1);
+	obs_properties_add_int(props, "max_retries", "Maximum reconnects",
+			1, 10000, 1);
+	return props;
+}
+
+struct obs_output_info rtmp_multi_output_info = {
+	.id             = "rtmp_multi_output",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED,
+	.getname        = rtmp_multi_getname,
+	.create         = rtmp_multi_create,
+	.destroy        = rtmp_multi_destroy,
+	.start          = rtmp_multi_start,
+	.stop           = rtmp_multi_stop,
+	.encoded_packet = rtmp_multi_data,
+	.defaults       = rtmp_multi_defaults,
+	.properties     = rtmp_multi_properties
+};
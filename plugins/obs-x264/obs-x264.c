@@ -26,8 +26,6 @@ struct obs_x264 {
 	x264_param_t    params;
 	x264_t          *context;
 
-	DARRAY(uint8_t) packet_data;
-
 	uint8_t         *extra_data;
 	uint8_t         *sei;
 
@@ -66,7 +64,6 @@ static void obs_x264_destroy(void *data)
 
 	if (obsx264) {
 		clear_data(obsx264);
-		da_free(obsx264->packet_data);
 		bfree(obsx264);
 	}
 }
@@ -297,21 +294,71 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t settings)
 	return success;
 }
 
-static bool obs_x264_update(void *data, obs_data_t settings)
+/* only rate control is changed on a running encoder.  it takes effect on the
+ * next frame without needing new headers, everything else requires the
+ * encoder to be recreated */
+static bool update_rate_control(struct obs_x264 *obsx264, obs_data_t settings)
 {
-	struct obs_x264 *obsx264 = data;
-	bool success = update_settings(obsx264, settings);
+	int bitrate     = (int)obs_data_getint(settings, "bitrate");
+	int buffer_size = (int)obs_data_getint(settings, "buffer_size");
+	int crf         = (int)obs_data_getint(settings, "crf");
+	x264_param_t *params = &obsx264->params;
 	int ret;
 
-	if (success) {
-		ret = x264_encoder_reconfig(obsx264->context, &obsx264->params);
-		if (ret != 0)
-			blog(LOG_WARNING, "Failed to reconfigure x264: %d",
-					ret);
-		return ret == 0;
+	x264_encoder_parameters(obsx264->context, params);
+
+	if (params->rc.i_rc_method == X264_RC_CRF)
+		params->rc.f_rf_constant = (float)crf;
+	else
+		params->rc.i_bitrate     = bitrate;
+
+	params->rc.i_vbv_max_bitrate = bitrate;
+	params->rc.i_vbv_buffer_size = buffer_size;
+
+	ret = x264_encoder_reconfig(obsx264->context, params);
+	if (ret != 0) {
+		blog(LOG_WARNING, "Failed to reconfigure x264: %d", ret);
+		return false;
 	}
 
-	return false;
+	blog(LOG_DEBUG, "x264 rate control updated: bitrate %d, "
+	                "buffer size %d", bitrate, buffer_size);
+	return true;
+}
+
+static void load_headers(struct obs_x264 *obsx264);
+
+/* while idle, the encoder is simply recreated with the new settings so that
+ * everything (rate control method, keyframe interval, preset, profile and
+ * x264 options) is applied.  the previous encoder is kept if that fails */
+static bool reopen_encoder(struct obs_x264 *obsx264, obs_data_t settings)
+{
+	struct obs_x264 old = *obsx264;
+
+	obsx264->context = NULL;
+
+	if (update_settings(obsx264, settings))
+		obsx264->context = x264_encoder_open(&obsx264->params);
+
+	if (!obsx264->context) {
+		blog(LOG_WARNING, "Failed to apply x264 settings");
+		*obsx264 = old;
+		return false;
+	}
+
+	clear_data(&old);
+	load_headers(obsx264);
+	return true;
+}
+
+static bool obs_x264_update(void *data, obs_data_t settings)
+{
+	struct obs_x264 *obsx264 = data;
+
+	if (obs_encoder_active(obsx264->encoder))
+		return update_rate_control(obsx264, settings);
+
+	return reopen_encoder(obsx264, settings);
 }
 
 static void load_headers(struct obs_x264 *obsx264)
@@ -370,18 +417,25 @@ static void parse_packet(struct obs_x264 *obsx264,
 		struct encoder_packet *packet, x264_nal_t *nals,
 		int nal_count, x264_picture_t *pic_out)
 {
+	size_t  size = 0;
+	uint8_t *data;
+
 	if (!nal_count) return;
 
-	da_resize(obsx264->packet_data, 0);
+	for (int i = 0; i < nal_count; i++)
+		size += nals[i].i_payload;
+
+	/* write the NALs straight into shared packet data, so libobs can
+	 * pass it to outputs without copying it again */
+	obs_alloc_encoder_packet(packet, size);
+	data = packet->data;
 
 	for (int i = 0; i < nal_count; i++) {
 		x264_nal_t *nal = nals+i;
-		da_push_back_array(obsx264->packet_data, nal->p_payload,
-				nal->i_payload);
+		memcpy(data, nal->p_payload, nal->i_payload);
+		data += nal->i_payload;
 	}
 
-	packet->data          = obsx264->packet_data.array;
-	packet->size          = obsx264->packet_data.num;
 	packet->type          = OBS_ENCODER_VIDEO;
 	packet->pts           = pic_out->i_pts;
 	packet->dts           = pic_out->i_dts;
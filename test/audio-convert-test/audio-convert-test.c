@@ -0,0 +1,488 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Checks the sample format conversions in media-io/audio-convert.c against
+ * plain scalar conversions, for every format, a few channel counts and
+ * frame counts around the vector widths.  Then checks the native channel
+ * remixes against swresample, which they replace, for each supported pair
+ * of layouts.
+ *
+ * Every buffer ends right at an inaccessible page, so reading or writing
+ * even one sample past the end of a buffer crashes the test instead of
+ * going unnoticed.  Returns non-zero if any conversion is wrong.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <util/bmem.h>
+#include <media-io/audio-convert.h>
+#include <libavutil/avutil.h>
+#include <libswresample/swresample.h>
+
+static const enum audio_format formats[] = {
+	AUDIO_FORMAT_U8BIT,
+	AUDIO_FORMAT_16BIT,
+	AUDIO_FORMAT_32BIT,
+	AUDIO_FORMAT_FLOAT,
+	AUDIO_FORMAT_U8BIT_PLANAR,
+	AUDIO_FORMAT_16BIT_PLANAR,
+	AUDIO_FORMAT_32BIT_PLANAR,
+	AUDIO_FORMAT_FLOAT_PLANAR,
+};
+
+static const size_t channel_counts[] = {1, 2, 6};
+
+/* around the 4 and 8 sample vector widths, and a typical packet size */
+static const size_t frame_counts[] = {
+	1, 2, 3, 4, 5, 7, 8, 9, 12, 16, 17, 480, 481
+};
+
+struct remix_pair {
+	enum speaker_layout src;
+	enum speaker_layout dst;
+};
+
+static const struct remix_pair remix_pairs[] = {
+	{SPEAKERS_MONO,             SPEAKERS_STEREO},
+	{SPEAKERS_STEREO,           SPEAKERS_MONO},
+	{SPEAKERS_5POINT1,          SPEAKERS_STEREO},
+	{SPEAKERS_5POINT1_SURROUND, SPEAKERS_STEREO},
+};
+
+/* swresample normalizes remixes to integer formats and not float ones, so
+ * both are covered */
+static const enum audio_format remix_formats[] = {
+	AUDIO_FORMAT_16BIT,
+	AUDIO_FORMAT_32BIT,
+	AUDIO_FORMAT_FLOAT,
+	AUDIO_FORMAT_16BIT_PLANAR,
+	AUDIO_FORMAT_FLOAT_PLANAR,
+};
+
+#define REMIX_FRAMES 480
+
+static int failures = 0;
+
+/* ------------------------------------------------------------------------- */
+/* buffers followed by an inaccessible page */
+
+struct guarded_buffer {
+	uint8_t *mem;
+	size_t  mem_size;
+	uint8_t *data;
+};
+
+static void guarded_alloc(struct guarded_buffer *buf, size_t size)
+{
+	size_t page  = (size_t)sysconf(_SC_PAGESIZE);
+	size_t pages = (size + page - 1) / page + 1;
+
+	buf->mem_size = pages * page;
+	buf->mem = mmap(NULL, buf->mem_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf->mem == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	mprotect(buf->mem + buf->mem_size - page, page, PROT_NONE);
+	buf->data = buf->mem + buf->mem_size - page - size;
+}
+
+static void guarded_free(struct guarded_buffer *buf)
+{
+	munmap(buf->mem, buf->mem_size);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *format_name(enum audio_format format)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:         return "u8";
+	case AUDIO_FORMAT_16BIT:         return "s16";
+	case AUDIO_FORMAT_32BIT:         return "s32";
+	case AUDIO_FORMAT_FLOAT:         return "float";
+	case AUDIO_FORMAT_U8BIT_PLANAR:  return "u8 planar";
+	case AUDIO_FORMAT_16BIT_PLANAR:  return "s16 planar";
+	case AUDIO_FORMAT_32BIT_PLANAR:  return "s32 planar";
+	case AUDIO_FORMAT_FLOAT_PLANAR:  return "float planar";
+	case AUDIO_FORMAT_UNKNOWN:       break;
+	}
+
+	return "unknown";
+}
+
+/* a test signal in the -1.0 to 1.0 range, different for each channel */
+static inline float test_sample(size_t channel, size_t frame)
+{
+	return sinf((float)(frame * (channel + 1)) * 0.37f) * 0.9f;
+}
+
+static void write_sample(uint8_t *data, enum audio_format format,
+		size_t idx, float val)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		data[idx] = (uint8_t)((int32_t)(val * 127.0f) + 128);
+		break;
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		((int16_t*)data)[idx] = (int16_t)(val * 32767.0f);
+		break;
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		((int32_t*)data)[idx] = (int32_t)((double)val * 2147483647.0);
+		break;
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		((float*)data)[idx] = val;
+		break;
+	case AUDIO_FORMAT_UNKNOWN:
+		break;
+	}
+}
+
+static float read_sample(const uint8_t *data, enum audio_format format,
+		size_t idx)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:
+	case AUDIO_FORMAT_U8BIT_PLANAR:
+		return ((float)data[idx] - 128.0f) / 128.0f;
+	case AUDIO_FORMAT_16BIT:
+	case AUDIO_FORMAT_16BIT_PLANAR:
+		return (float)((const int16_t*)data)[idx] / 32768.0f;
+	case AUDIO_FORMAT_32BIT:
+	case AUDIO_FORMAT_32BIT_PLANAR:
+		return (float)((const int32_t*)data)[idx] / 2147483648.0f;
+	case AUDIO_FORMAT_FLOAT:
+	case AUDIO_FORMAT_FLOAT_PLANAR:
+		return ((const float*)data)[idx];
+	case AUDIO_FORMAT_UNKNOWN:
+		break;
+	}
+
+	return 0.0f;
+}
+
+static void check(bool success, const char *test, enum audio_format format,
+		size_t channels, size_t frames, size_t channel, size_t frame)
+{
+	if (!success) {
+		fprintf(stderr, "%s failed: %s, %d channel(s), %d frame(s), "
+		                "channel %d, frame %d\n", test,
+		                format_name(format), (int)channels,
+		                (int)frames, (int)channel, (int)frame);
+		failures++;
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* converts each channel to float with audio_format_to_float */
+static void test_to_float(enum audio_format format, size_t channels,
+		size_t frames)
+{
+	struct guarded_buffer in[MAX_AV_PLANES];
+	struct guarded_buffer out;
+	bool   planar = is_audio_planar(format);
+	size_t planes = planar ? channels : 1;
+	size_t stride = planar ? 1 : channels;
+	size_t size   = get_audio_bytes_per_channel(format) * frames * stride;
+	float  volume = 0.5f;
+
+	for (size_t i = 0; i < planes; i++)
+		guarded_alloc(&in[i], size);
+	guarded_alloc(&out, frames * sizeof(float));
+
+	for (size_t ch = 0; ch < channels; ch++)
+		for (size_t i = 0; i < frames; i++)
+			write_sample(in[planar ? ch : 0].data, format,
+					planar ? i : i * channels + ch,
+					test_sample(ch, i));
+
+	for (size_t ch = 0; ch < channels; ch++) {
+		const uint8_t *data   = in[planar ? ch : 0].data;
+		size_t         offset = planar ? 0 : ch;
+		const float   *vals   = (const float*)out.data;
+
+		audio_format_to_float((float*)out.data, data, format, offset,
+				stride, frames, volume);
+
+		for (size_t i = 0; i < frames; i++) {
+			float expected = read_sample(data, format,
+					offset + i * stride) * volume;
+			check(fabsf(vals[i] - expected) < 1e-6f,
+					"audio_format_to_float", format,
+					channels, frames, ch, i);
+		}
+	}
+
+	for (size_t i = 0; i < planes; i++)
+		guarded_free(&in[i]);
+	guarded_free(&out);
+}
+
+/* converts float planar channels with audio_format_from_float_planes */
+static void test_from_float(enum audio_format format, size_t channels,
+		size_t frames)
+{
+	struct guarded_buffer in[MAX_AV_PLANES];
+	struct guarded_buffer out[MAX_AV_PLANES];
+	struct guarded_buffer expected;
+	const float *in_ptrs[MAX_AV_PLANES];
+	uint8_t     *out_ptrs[MAX_AV_PLANES];
+	bool   planar = is_audio_planar(format);
+	size_t planes = planar ? channels : 1;
+	size_t stride = planar ? 1 : channels;
+	size_t size   = get_audio_bytes_per_channel(format) * frames * stride;
+
+	for (size_t ch = 0; ch < channels; ch++) {
+		guarded_alloc(&in[ch], frames * sizeof(float));
+		in_ptrs[ch] = (const float*)in[ch].data;
+
+		for (size_t i = 0; i < frames; i++)
+			((float*)in[ch].data)[i] = test_sample(ch, i);
+	}
+
+	for (size_t i = 0; i < planes; i++) {
+		guarded_alloc(&out[i], size);
+		out_ptrs[i] = out[i].data;
+	}
+
+	guarded_alloc(&expected, size);
+
+	audio_format_from_float_planes(out_ptrs, in_ptrs, format, channels,
+			frames);
+
+	for (size_t ch = 0; ch < channels; ch++) {
+		const uint8_t *data   = out[planar ? ch : 0].data;
+		size_t         offset = planar ? 0 : ch;
+
+		for (size_t i = 0; i < frames; i++) {
+			size_t idx = offset + i * stride;
+			float  val;
+
+			write_sample(expected.data, format, idx,
+					test_sample(ch, i));
+
+			/* allow for rounding in the vectorized paths */
+			val = read_sample(expected.data, format, idx);
+			check(fabsf(read_sample(data, format, idx) - val) <=
+					1.0f / 32768.0f,
+					"audio_format_from_float_planes",
+					format, channels, frames, ch, i);
+		}
+	}
+
+	for (size_t ch = 0; ch < channels; ch++)
+		guarded_free(&in[ch]);
+	for (size_t i = 0; i < planes; i++)
+		guarded_free(&out[i]);
+	guarded_free(&expected);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static enum AVSampleFormat convert_audio_format(enum audio_format format)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:        return AV_SAMPLE_FMT_U8;
+	case AUDIO_FORMAT_16BIT:        return AV_SAMPLE_FMT_S16;
+	case AUDIO_FORMAT_32BIT:        return AV_SAMPLE_FMT_S32;
+	case AUDIO_FORMAT_FLOAT:        return AV_SAMPLE_FMT_FLT;
+	case AUDIO_FORMAT_U8BIT_PLANAR: return AV_SAMPLE_FMT_U8P;
+	case AUDIO_FORMAT_16BIT_PLANAR: return AV_SAMPLE_FMT_S16P;
+	case AUDIO_FORMAT_32BIT_PLANAR: return AV_SAMPLE_FMT_S32P;
+	case AUDIO_FORMAT_FLOAT_PLANAR: return AV_SAMPLE_FMT_FLTP;
+	case AUDIO_FORMAT_UNKNOWN:      break;
+	}
+
+	return AV_SAMPLE_FMT_NONE;
+}
+
+static uint64_t convert_speaker_layout(enum speaker_layout layout)
+{
+	switch (layout) {
+	case SPEAKERS_MONO:             return AV_CH_LAYOUT_MONO;
+	case SPEAKERS_STEREO:           return AV_CH_LAYOUT_STEREO;
+	case SPEAKERS_5POINT1:          return AV_CH_LAYOUT_5POINT1;
+	case SPEAKERS_5POINT1_SURROUND: return AV_CH_LAYOUT_5POINT1_BACK;
+	default:                        break;
+	}
+
+	return 0;
+}
+
+/* converts with swresample, returns false if it fails */
+static bool swr_remix(uint8_t *const out[], const uint8_t *const in[],
+		const struct resample_info *dst,
+		const struct resample_info *src, int frames)
+{
+	struct SwrContext *context;
+	int ret;
+
+	context = swr_alloc_set_opts(NULL,
+			convert_speaker_layout(dst->speakers),
+			convert_audio_format(dst->format), dst->samples_per_sec,
+			convert_speaker_layout(src->speakers),
+			convert_audio_format(src->format), src->samples_per_sec,
+			0, NULL);
+	if (!context || swr_init(context) != 0) {
+		swr_free(&context);
+		return false;
+	}
+
+	ret = swr_convert(context, (uint8_t**)out, frames,
+			(const uint8_t**)in, frames);
+	swr_free(&context);
+	return ret == frames;
+}
+
+/* remixes natively and with swresample, and compares the two */
+static void test_remix(const struct remix_pair *pair,
+		enum audio_format src_format, enum audio_format dst_format)
+{
+	struct resample_info src = {48000, src_format, pair->src};
+	struct resample_info dst = {48000, dst_format, pair->dst};
+	struct guarded_buffer in[MAX_AV_PLANES];
+	struct guarded_buffer expected[MAX_AV_PLANES];
+	const uint8_t *in_ptrs[MAX_AV_PLANES];
+	uint8_t       *expected_ptrs[MAX_AV_PLANES];
+	uint8_t       *output[MAX_AV_PLANES];
+	audio_convert_t convert;
+
+	bool   src_planar   = is_audio_planar(src_format);
+	bool   dst_planar   = is_audio_planar(dst_format);
+	size_t src_channels = get_audio_channels(pair->src);
+	size_t dst_channels = get_audio_channels(pair->dst);
+	size_t src_planes   = src_planar ? src_channels : 1;
+	size_t dst_planes   = dst_planar ? dst_channels : 1;
+	size_t src_stride   = src_planar ? 1 : src_channels;
+	size_t dst_stride   = dst_planar ? 1 : dst_channels;
+
+	/* float output isn't normalized, so keep the 5.1 downmix in range */
+	float  level        = 0.3f;
+
+	/* allow for swresample's integer rematrixing */
+	bool   dst_float    = dst_format == AUDIO_FORMAT_FLOAT ||
+	                      dst_format == AUDIO_FORMAT_FLOAT_PLANAR;
+	float  tolerance    = dst_float ? 1e-5f : 4.0f / 32768.0f;
+
+	for (size_t i = 0; i < src_planes; i++) {
+		guarded_alloc(&in[i], get_audio_bytes_per_channel(src_format) *
+				REMIX_FRAMES * src_stride);
+		in_ptrs[i] = in[i].data;
+	}
+
+	for (size_t i = 0; i < dst_planes; i++) {
+		guarded_alloc(&expected[i],
+				get_audio_bytes_per_channel(dst_format) *
+				REMIX_FRAMES * dst_stride);
+		expected_ptrs[i] = expected[i].data;
+	}
+
+	for (size_t ch = 0; ch < src_channels; ch++)
+		for (size_t i = 0; i < REMIX_FRAMES; i++)
+			write_sample(in[src_planar ? ch : 0].data, src_format,
+					src_planar ? i : i * src_channels + ch,
+					test_sample(ch, i) * level);
+
+	if (!swr_remix(expected_ptrs, in_ptrs, &dst, &src, REMIX_FRAMES)) {
+		fprintf(stderr, "swresample failed: %s to %s\n",
+				format_name(src_format),
+				format_name(dst_format));
+		failures++;
+		goto fail;
+	}
+
+	convert = audio_convert_create(&dst, &src);
+	if (!convert) {
+		check(false, "audio_convert_create", src_format, src_channels,
+				REMIX_FRAMES, 0, 0);
+		goto fail;
+	}
+
+	audio_convert_process(convert, output, in_ptrs, REMIX_FRAMES);
+
+	for (size_t ch = 0; ch < dst_channels; ch++) {
+		const uint8_t *data = output[dst_planar ? ch : 0];
+		const uint8_t *ref  = expected[dst_planar ? ch : 0].data;
+
+		for (size_t i = 0; i < REMIX_FRAMES; i++) {
+			size_t idx = dst_planar ? i : i * dst_channels + ch;
+			float  val = read_sample(data, dst_format, idx);
+
+			check(fabsf(val - read_sample(ref, dst_format, idx)) <=
+					tolerance, "remix", dst_format,
+					src_channels, REMIX_FRAMES, ch, i);
+		}
+	}
+
+	audio_convert_destroy(convert);
+
+fail:
+	for (size_t i = 0; i < src_planes; i++)
+		guarded_free(&in[i]);
+	for (size_t i = 0; i < dst_planes; i++)
+		guarded_free(&expected[i]);
+}
+
+int main(void)
+{
+	size_t num_formats = sizeof(formats) / sizeof(formats[0]);
+	size_t num_channel_counts =
+		sizeof(channel_counts) / sizeof(channel_counts[0]);
+	size_t num_frame_counts = sizeof(frame_counts) / sizeof(frame_counts[0]);
+
+	for (size_t i = 0; i < num_formats; i++) {
+		for (size_t j = 0; j < num_channel_counts; j++) {
+			for (size_t k = 0; k < num_frame_counts; k++) {
+				test_to_float(formats[i], channel_counts[j],
+						frame_counts[k]);
+				test_from_float(formats[i], channel_counts[j],
+						frame_counts[k]);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < sizeof(remix_pairs) / sizeof(remix_pairs[0]);
+			i++) {
+		size_t num_remix_formats =
+			sizeof(remix_formats) / sizeof(remix_formats[0]);
+
+		for (size_t j = 0; j < num_remix_formats; j++)
+			for (size_t k = 0; k < num_remix_formats; k++)
+				test_remix(&remix_pairs[i], remix_formats[j],
+						remix_formats[k]);
+	}
+
+	if (failures)
+		printf("%d check(s) failed\n", failures);
+	else
+		printf("all checks passed\n");
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,274 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Measures the CPU cost of mixing audio lines in the audio output, for each
+ * sample format and a few channel layouts.
+ *
+ * The audio output mixes on its own clock, so each configuration feeds a
+ * number of audio lines with 10 millisecond packets in real time, with one
+ * input connected in the output's own format, and reports the CPU time the
+ * process used per second of audio.  Run it before and after a change to
+ * the mixer to compare the two.
+ *
+ * The packets are full scale noise so that the mix actually clips.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/audio-io.h>
+
+#define BENCH_SAMPLE_RATE 48000
+#define PACKET_FRAMES     480
+#define PACKET_NS         10000000ULL
+#define MAX_LINES         256
+
+struct bench_options {
+	int   lines;
+	int   duration_sec;
+	float volume;
+};
+
+struct bench_config {
+	enum audio_format   format;
+	enum speaker_layout speakers;
+};
+
+static const char *format_name(enum audio_format format)
+{
+	switch (format) {
+	case AUDIO_FORMAT_U8BIT:         return "u8";
+	case AUDIO_FORMAT_16BIT:         return "s16";
+	case AUDIO_FORMAT_32BIT:         return "s32";
+	case AUDIO_FORMAT_FLOAT:         return "float";
+	case AUDIO_FORMAT_U8BIT_PLANAR:  return "u8 planar";
+	case AUDIO_FORMAT_16BIT_PLANAR:  return "s16 planar";
+	case AUDIO_FORMAT_32BIT_PLANAR:  return "s32 planar";
+	case AUDIO_FORMAT_FLOAT_PLANAR:  return "float planar";
+	case AUDIO_FORMAT_UNKNOWN:       break;
+	}
+
+	return "unknown";
+}
+
+static inline uint64_t process_cpu_time_ns(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+		1000000000ULL +
+		(uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+		1000ULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* only written by the audio thread, and read once it has stopped */
+static uint64_t frames_received = 0;
+
+static void receive_audio(void *param, struct audio_data *data)
+{
+	frames_received += data->frames;
+
+	UNUSED_PARAMETER(param);
+}
+
+static void fill_noise(uint8_t *data, size_t size, enum audio_format format)
+{
+	uint32_t seed = 0x12345678;
+
+	for (size_t i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = (uint8_t)(seed >> 16);
+	}
+
+	/* random bytes make for NaNs and huge values as floats */
+	if (format == AUDIO_FORMAT_FLOAT ||
+	    format == AUDIO_FORMAT_FLOAT_PLANAR) {
+		float *samples = (float*)data;
+
+		for (size_t i = 0; i < size / sizeof(float); i++) {
+			seed = seed * 1103515245 + 12345;
+			samples[i] = (float)(seed >> 8) / 8388608.0f - 1.0f;
+		}
+	}
+}
+
+/* returns the cpu time used per second of audio in milliseconds, or a
+ * negative value on failure */
+static double run_config(struct bench_options *opts,
+		const struct bench_config *config)
+{
+	struct audio_output_info info = {
+		.name            = "bench",
+		.samples_per_sec = BENCH_SAMPLE_RATE,
+		.format          = config->format,
+		.speakers        = config->speakers,
+		.buffer_ms       = 100
+	};
+	audio_line_t    lines[MAX_LINES];
+	struct audio_data packet = {0};
+	size_t          planes   = get_audio_planes(config->format,
+			config->speakers);
+	size_t          plane_size = get_audio_size(config->format,
+			config->speakers, PACKET_FRAMES);
+	uint8_t         *buffer;
+	audio_t         audio;
+	uint64_t        start_ns, start_cpu_ns, cpu_ns;
+	int             packets = opts->duration_sec * 100;
+
+	if (audio_output_open(&audio, &info) != AUDIO_OUTPUT_SUCCESS)
+		return -1.0;
+
+	buffer = bmalloc(plane_size * planes);
+	fill_noise(buffer, plane_size * planes, config->format);
+
+	for (size_t i = 0; i < planes; i++)
+		packet.data[i] = buffer + plane_size * i;
+	packet.frames = PACKET_FRAMES;
+	packet.volume = opts->volume;
+
+	for (int i = 0; i < opts->lines; i++)
+		lines[i] = audio_output_createline(audio, "bench line");
+
+	audio_output_connect(audio, 0, NULL, receive_audio, NULL);
+	frames_received = 0;
+
+	start_ns     = os_gettime_ns();
+	start_cpu_ns = process_cpu_time_ns();
+
+	for (int i = 0; i < packets; i++) {
+		packet.timestamp = start_ns + PACKET_NS * i;
+
+		for (int j = 0; j < opts->lines; j++)
+			audio_line_output(lines[j], &packet);
+
+		os_sleepto_ns(start_ns + PACKET_NS * (i + 1));
+	}
+
+	cpu_ns = process_cpu_time_ns() - start_cpu_ns;
+
+	audio_output_disconnect(audio, 0, receive_audio, NULL);
+	for (int i = 0; i < opts->lines; i++)
+		audio_line_destroy(lines[i]);
+	audio_output_close(audio);
+	bfree(buffer);
+
+	if (!frames_received)
+		return -1.0;
+
+	return (double)cpu_ns / 1000000.0 / (double)opts->duration_sec;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const enum audio_format formats[] = {
+	AUDIO_FORMAT_U8BIT,
+	AUDIO_FORMAT_16BIT,
+	AUDIO_FORMAT_32BIT,
+	AUDIO_FORMAT_FLOAT,
+	AUDIO_FORMAT_U8BIT_PLANAR,
+	AUDIO_FORMAT_16BIT_PLANAR,
+	AUDIO_FORMAT_32BIT_PLANAR,
+	AUDIO_FORMAT_FLOAT_PLANAR
+};
+
+static const enum speaker_layout layouts[] = {
+	SPEAKERS_MONO,
+	SPEAKERS_STEREO,
+	SPEAKERS_5POINT1
+};
+
+static void print_usage(const char *name)
+{
+	printf("usage: %s [options]\n"
+	       "  --lines <count>           audio lines to mix (default 32)\n"
+	       "  --duration <sec>          length of each run (default 2)\n"
+	       "  --volume <volume>         volume of the lines "
+	                                   "(default 0.5)\n",
+	       name);
+}
+
+static bool parse_options(int argc, char *argv[], struct bench_options *opts)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg   = argv[i];
+		const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (!value)
+			return false;
+
+		if      (strcmp(arg, "--lines") == 0)
+			opts->lines = atoi(value);
+		else if (strcmp(arg, "--duration") == 0)
+			opts->duration_sec = atoi(value);
+		else if (strcmp(arg, "--volume") == 0)
+			opts->volume = (float)atof(value);
+		else
+			return false;
+
+		i++;
+	}
+
+	return opts->lines > 0 && opts->lines <= MAX_LINES &&
+		opts->duration_sec > 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_options opts = {
+		.lines        = 32,
+		.duration_sec = 2,
+		.volume       = 0.5f
+	};
+
+	if (!parse_options(argc, argv, &opts)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	printf("%d lines, volume %.2f, cpu time per second of audio:\n",
+			opts.lines, opts.volume);
+	printf("%-14s %10s %10s %10s\n", "format", "mono", "stereo", "5.1");
+
+	for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		printf("%-14s", format_name(formats[i]));
+
+		for (size_t j = 0; j < sizeof(layouts) / sizeof(layouts[0]);
+				j++) {
+			struct bench_config config = {formats[i], layouts[j]};
+			double ms = run_config(&opts, &config);
+
+			if (ms < 0.0)
+				printf(" %10s", "failed");
+			else
+				printf(" %7.2f ms", ms);
+			fflush(stdout);
+		}
+
+		printf("\n");
+	}
+
+	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	return 0;
+}
@@ -0,0 +1,853 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+/*
+ * Streams synthetic encoder packets through the RTMP output to the loopback
+ * sink in rtmp-sink.c, and reports throughput, latency, dropped frames and
+ * the CPU cost of sending.
+ *
+ * The encoders don't encode anything: they output packets of the size the
+ * configured bitrate would produce, made up of valid NAL units so that the
+ * output parses them the same way it parses x264 output.  Every video frame
+ * carries the time it was output by the encoder, which the sink uses to
+ * measure the latency.
+ *
+ * With --destinations, the multi-destination output streams to several
+ * sinks at once.  The link limit and disconnect then only apply to the
+ * first sink, so that it can be checked that the others aren't affected.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include <obs.h>
+#include <obs-avc.h>
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "rtmp-sink.h"
+
+#define BENCH_WIDTH         64
+#define BENCH_HEIGHT        64
+#define BENCH_SAMPLE_RATE   48000
+#define AAC_FRAME_SIZE      1024
+#define KEYFRAME_SIZE_MUL   4
+#define DRAIN_TIMEOUT_MS    10000
+#define MAX_DESTINATIONS    16
+
+#define NAL_SLICE           1
+#define NAL_SLICE_IDR       5
+
+extern struct obs_output_info rtmp_output_info;
+extern struct obs_output_info rtmp_multi_output_info;
+
+struct bench_options {
+	int  bitrate;
+	int  audio_bitrate;
+	int  fps;
+	int  keyint_sec;
+	int  duration_sec;
+	int  limit_kbps;
+	int  drop_threshold_ms;
+	int  disconnect_sec;
+	int  destinations;
+	bool low_latency;
+	bool adaptive_bitrate;
+};
+
+static volatile long video_frames_output = 0;
+
+/* ------------------------------------------------------------------------- */
+/* service */
+
+static const char *bench_service_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "Loopback RTMP sink";
+}
+
+static void *bench_service_create(obs_data_t settings, obs_service_t service)
+{
+	UNUSED_PARAMETER(service);
+	return bstrdup(obs_data_getstring(settings, "url"));
+}
+
+static void bench_service_destroy(void *data)
+{
+	bfree(data);
+}
+
+static const char *bench_service_url(void *data)
+{
+	return data;
+}
+
+static const char *bench_service_key(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return "bench";
+}
+
+static struct obs_service_info bench_service = {
+	.id      = "bench_service",
+	.getname = bench_service_getname,
+	.create  = bench_service_create,
+	.destroy = bench_service_destroy,
+	.get_url = bench_service_url,
+	.get_key = bench_service_key
+};
+
+/* ------------------------------------------------------------------------- */
+/* synthetic video encoder */
+
+struct bench_video {
+	obs_encoder_t encoder;
+	int           bitrate;
+	int           keyint;
+	int           frame_idx;
+};
+
+/* baseline SPS/PPS, only the header parsing in libobs looks at them */
+static uint8_t bench_video_header[] = {
+	0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1F,
+	0xDA, 0x01, 0x40, 0x16, 0xE8,
+	0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x3C, 0x80
+};
+
+static const char *bench_video_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "Synthetic video";
+}
+
+static bool bench_video_update(void *data, obs_data_t settings)
+{
+	struct bench_video *bv = data;
+	bv->bitrate = (int)obs_data_getint(settings, "bitrate");
+	return true;
+}
+
+static void *bench_video_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	struct bench_video *bv = bzalloc(sizeof(struct bench_video));
+	bv->encoder = encoder;
+	bv->keyint  = (int)obs_data_getint(settings, "keyint");
+	if (bv->keyint < 1)
+		bv->keyint = 1;
+
+	bench_video_update(bv, settings);
+	return bv;
+}
+
+static void bench_video_destroy(void *data)
+{
+	bfree(data);
+}
+
+/* keyframes are larger than the rest of the frames, but the average over a
+ * keyframe interval matches the bitrate */
+static size_t bench_frame_size(struct bench_video *bv, bool keyframe)
+{
+	video_t video = obs_encoder_video(bv->encoder);
+	double  avg   = (double)bv->bitrate * 1000.0 / 8.0 /
+		video_output_framerate(video);
+
+	if (bv->keyint <= KEYFRAME_SIZE_MUL)
+		return (size_t)avg;
+	if (keyframe)
+		return (size_t)(avg * KEYFRAME_SIZE_MUL);
+
+	return (size_t)(avg * (bv->keyint - KEYFRAME_SIZE_MUL) /
+			(bv->keyint - 1));
+}
+
+/* every other frame between keyframes is disposable, which gives the frame
+ * dropping in the output something to choose from */
+static inline uint8_t bench_nal_header(struct bench_video *bv, bool keyframe)
+{
+	if (keyframe)
+		return (OBS_NAL_PRIORITY_HIGHEST << 5) | NAL_SLICE_IDR;
+	if (bv->frame_idx % 2)
+		return (OBS_NAL_PRIORITY_HIGH << 5) | NAL_SLICE;
+
+	return (OBS_NAL_PRIORITY_DISPOSABLE << 5) | NAL_SLICE;
+}
+
+static bool bench_video_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct bench_video *bv       = data;
+	bool                keyframe = (bv->frame_idx == 0);
+	size_t              min_size = 5 + RTMP_SINK_MARKER_SIZE + 16 + 1;
+	size_t              size     = bench_frame_size(bv, keyframe);
+	uint8_t             *out;
+
+	if (size < min_size)
+		size = min_size;
+
+	obs_alloc_encoder_packet(packet, size);
+	out = packet->data;
+
+	/* fill with non-zero bytes so that nothing looks like a start code */
+	memset(out, 0xAA, size);
+	out[0] = 0;
+	out[1] = 0;
+	out[2] = 0;
+	out[3] = 1;
+	out[4] = bench_nal_header(bv, keyframe);
+	snprintf((char*)out + 5, RTMP_SINK_MARKER_SIZE + 17, "%s%016llx",
+			RTMP_SINK_MARKER,
+			(unsigned long long)os_gettime_ns());
+	out[5 + RTMP_SINK_MARKER_SIZE + 16] = 0xAA;
+
+	packet->type     = OBS_ENCODER_VIDEO;
+	packet->pts      = frame->pts;
+	packet->dts      = frame->pts;
+	packet->keyframe = keyframe;
+	*received_packet = true;
+
+	if (++bv->frame_idx == bv->keyint)
+		bv->frame_idx = 0;
+
+	os_atomic_inc_long(&video_frames_output);
+	return true;
+}
+
+static bool bench_video_extra_data(void *data, uint8_t **extra_data,
+		size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	*extra_data = bench_video_header;
+	*size       = sizeof(bench_video_header);
+	return true;
+}
+
+static struct obs_encoder_info bench_video_encoder = {
+	.id         = "bench_video",
+	.type       = OBS_ENCODER_VIDEO,
+	.codec      = "h264",
+	.getname    = bench_video_getname,
+	.create     = bench_video_create,
+	.destroy    = bench_video_destroy,
+	.encode     = bench_video_encode,
+	.update     = bench_video_update,
+	.extra_data = bench_video_extra_data
+};
+
+/* ------------------------------------------------------------------------- */
+/* synthetic audio encoder */
+
+struct bench_audio {
+	int bitrate;
+};
+
+/* AAC-LC, 48khz, stereo */
+static uint8_t bench_audio_header[] = {0x11, 0x90};
+
+static const char *bench_audio_getname(const char *locale)
+{
+	UNUSED_PARAMETER(locale);
+	return "Synthetic audio";
+}
+
+static void *bench_audio_create(obs_data_t settings, obs_encoder_t encoder)
+{
+	struct bench_audio *ba = bzalloc(sizeof(struct bench_audio));
+	ba->bitrate = (int)obs_data_getint(settings, "bitrate");
+
+	UNUSED_PARAMETER(encoder);
+	return ba;
+}
+
+static void bench_audio_destroy(void *data)
+{
+	bfree(data);
+}
+
+static bool bench_audio_encode(void *data, struct encoder_frame *frame,
+		struct encoder_packet *packet, bool *received_packet)
+{
+	struct bench_audio *ba = data;
+	size_t size = (size_t)ba->bitrate * 1000 / 8 * AAC_FRAME_SIZE /
+		BENCH_SAMPLE_RATE;
+
+	obs_alloc_encoder_packet(packet, size ? size : 1);
+	memset(packet->data, 0xAA, packet->size);
+
+	packet->type     = OBS_ENCODER_AUDIO;
+	packet->pts      = frame->pts;
+	packet->dts      = frame->pts;
+	*received_packet = true;
+	return true;
+}
+
+static size_t bench_audio_frame_size(void *data)
+{
+	UNUSED_PARAMETER(data);
+	return AAC_FRAME_SIZE;
+}
+
+static bool bench_audio_extra_data(void *data, uint8_t **extra_data,
+		size_t *size)
+{
+	UNUSED_PARAMETER(data);
+	*extra_data = bench_audio_header;
+	*size       = sizeof(bench_audio_header);
+	return true;
+}
+
+static struct obs_encoder_info bench_audio_encoder = {
+	.id         = "bench_audio",
+	.type       = OBS_ENCODER_AUDIO,
+	.codec      = "AAC",
+	.getname    = bench_audio_getname,
+	.create     = bench_audio_create,
+	.destroy    = bench_audio_destroy,
+	.encode     = bench_audio_encode,
+	.frame_size = bench_audio_frame_size,
+	.extra_data = bench_audio_extra_data
+};
+
+/* ------------------------------------------------------------------------- */
+/* raw video, takes the place of the graphics thread */
+
+struct frame_source {
+	video_t           video;
+	pthread_t         thread;
+	uint8_t           *planes;
+	struct video_data frame;
+};
+
+static void *frame_thread(void *data)
+{
+	struct frame_source *source = data;
+
+	while (video_output_wait(source->video)) {
+		source->frame.timestamp = video_gettime(source->video);
+		video_output_swap_frame(source->video, &source->frame);
+	}
+
+	return NULL;
+}
+
+static bool frame_source_start(struct frame_source *source, video_t video)
+{
+	size_t luma_size = BENCH_WIDTH * BENCH_HEIGHT;
+
+	source->video  = video;
+	source->planes = bzalloc(luma_size * 3 / 2);
+
+	source->frame.data[0]     = source->planes;
+	source->frame.data[1]     = source->planes + luma_size;
+	source->frame.data[2]     = source->planes + luma_size * 5 / 4;
+	source->frame.linesize[0] = BENCH_WIDTH;
+	source->frame.linesize[1] = BENCH_WIDTH / 2;
+	source->frame.linesize[2] = BENCH_WIDTH / 2;
+
+	return pthread_create(&source->thread, NULL, frame_thread,
+			source) == 0;
+}
+
+static void frame_source_stop(struct frame_source *source)
+{
+	video_output_stop(source->video);
+	pthread_join(source->thread, NULL);
+	bfree(source->planes);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static volatile long output_stop_code = -1;
+
+static void output_stopped(void *data, calldata_t params)
+{
+	long long code = 0;
+	calldata_getint(params, "errorcode", &code);
+	os_atomic_set_long(&output_stop_code, (long)code);
+
+	UNUSED_PARAMETER(data);
+}
+
+static inline uint64_t process_cpu_time_ns(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return (uint64_t)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+		1000000000ULL +
+		(uint64_t)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+		1000ULL;
+}
+
+static long long get_stat(calldata_t params, const char *name)
+{
+	long long val = 0;
+	calldata_getint(params, name, &val);
+	return val;
+}
+
+/* gets the network stats of the output, or of one of the destinations of
+ * the multi-destination output */
+static void get_output_stats(struct bench_options *opts, obs_output_t output,
+		int idx, calldata_t params)
+{
+	proc_handler_t handler = obs_output_prochandler(output);
+
+	if (opts->destinations > 1) {
+		calldata_setint(params, "index", idx);
+		proc_handler_call(handler, "get_destination_stats", params);
+	} else {
+		proc_handler_call(handler, "get_network_stats", params);
+	}
+}
+
+static long long get_output_dropped(struct bench_options *opts,
+		obs_output_t output, int idx)
+{
+	struct calldata params = {0};
+	long long       dropped;
+
+	get_output_stats(opts, output, idx, &params);
+	dropped = get_stat(&params, "dropped_frames");
+
+	calldata_free(&params);
+	return dropped;
+}
+
+static void print_progress(struct bench_options *opts, int sec,
+		obs_output_t output, struct rtmp_sink_stats *stats,
+		uint64_t *last_bytes)
+{
+	struct calldata params = {0};
+	uint64_t        bytes  = stats->bytes_received - *last_bytes;
+
+	get_output_stats(opts, output, 0, &params);
+
+	printf("%4ds  bitrate %6lld kbps  sent %6lld kbps  received %6llu kbps"
+	       "  buffered %5lld ms  rtt %6lld us  reconnects %lld\n",
+			sec,
+			get_stat(&params, "bitrate"),
+			get_stat(&params, "throughput_kbps"),
+			(unsigned long long)(bytes * 8 / 1000),
+			get_stat(&params, "buffer_ms"),
+			get_stat(&params, "rtt_us"),
+			get_stat(&params, "reconnects"));
+
+	fflush(stdout);
+
+	*last_bytes = stats->bytes_received;
+	calldata_free(&params);
+}
+
+static void print_results(struct bench_options *opts,
+		struct rtmp_sink_stats *stats, long long output_dropped,
+		uint64_t elapsed_ns, uint64_t cpu_time_ns)
+{
+	long     frames_output = os_atomic_load_long(&video_frames_output);
+	uint64_t sender_cpu_ns = cpu_time_ns > stats->cpu_time_ns ?
+		cpu_time_ns - stats->cpu_time_ns : 0;
+	double   seconds       = (double)elapsed_ns / 1000000000.0;
+	double   megabytes     = (double)stats->bytes_received / 1000000.0;
+	long     lost          = frames_output - (long)stats->video_frames;
+
+	printf("\n");
+	printf("bitrate:          %d kbps video, %d kbps audio\n",
+			opts->bitrate, opts->audio_bitrate);
+	printf("link limit:       %d kbps%s\n", opts->limit_kbps,
+			opts->limit_kbps ? "" : " (unlimited)");
+	printf("received:         %.2f MB in %.2f s (%.0f kbps)\n",
+			megabytes, seconds, megabytes * 8000.0 / seconds);
+	printf("video frames:     %ld output, %llu received, %lld dropped "
+	       "(%.2f%%)\n",
+			frames_output,
+			(unsigned long long)stats->video_frames, output_dropped,
+			frames_output ?
+				(double)output_dropped * 100.0 / frames_output :
+				0.0);
+
+	/* frames from before the output started, or that were being sent
+	 * when the connection was lost */
+	if (lost > output_dropped)
+		printf("                  %lld not sent for other reasons\n",
+				(long long)lost - output_dropped);
+	printf("audio frames:     %llu received\n",
+			(unsigned long long)stats->audio_frames);
+	printf("keyframes:        %llu received\n",
+			(unsigned long long)stats->keyframes);
+	printf("connections:      %d\n", stats->connections);
+	printf("latency:          avg %.2f ms, p50 %.2f ms, p95 %.2f ms, "
+	       "max %.2f ms\n",
+			stats->latency_avg_us / 1000.0,
+			stats->latency_p50_us / 1000.0,
+			stats->latency_p95_us / 1000.0,
+			stats->latency_max_us / 1000.0);
+	printf("sender cpu:       %.3f s (%.2f%% of one core, "
+	       "%.2f ms per MB)\n",
+			sender_cpu_ns / 1000000000.0,
+			(double)sender_cpu_ns * 100.0 / (double)elapsed_ns,
+			megabytes > 0.0 ?
+				sender_cpu_ns / 1000000.0 / megabytes : 0.0);
+	printf("sink cpu:         %.3f s\n",
+			stats->cpu_time_ns / 1000000000.0);
+}
+
+static void print_destination(int idx, struct rtmp_sink_stats *stats,
+		long long output_dropped)
+{
+	printf("destination %2d:   %.2f MB, %llu video frames, %lld dropped, "
+	       "latency avg %.2f ms, max %.2f ms\n",
+			idx, (double)stats->bytes_received / 1000000.0,
+			(unsigned long long)stats->video_frames, output_dropped,
+			stats->latency_avg_us / 1000.0,
+			stats->latency_max_us / 1000.0);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void set_destinations(obs_data_t settings, rtmp_sink_t *sinks,
+		int count)
+{
+	obs_data_array_t array = obs_data_array_create();
+
+	for (int i = 0; i < count; i++) {
+		obs_data_t destination = obs_data_create();
+		char       url[64];
+
+		snprintf(url, sizeof(url), "rtmp://127.0.0.1:%d/live",
+				rtmp_sink_port(sinks[i]));
+		obs_data_setstring(destination, "url", url);
+		obs_data_array_push_back(array, destination);
+		obs_data_release(destination);
+	}
+
+	obs_data_setarray(settings, "destinations", array);
+	obs_data_array_release(array);
+}
+
+static obs_output_t create_output(struct bench_options *opts,
+		obs_encoder_t venc, obs_encoder_t aenc, obs_service_t service,
+		rtmp_sink_t *sinks)
+{
+	obs_data_t   settings = obs_data_create();
+	bool         multi    = opts->destinations > 1;
+	obs_output_t output;
+
+	obs_data_setint(settings, "drop_threshold",
+			opts->drop_threshold_ms * 1000);
+	obs_data_setbool(settings, "low_latency", opts->low_latency);
+	obs_data_setbool(settings, "adaptive_bitrate",
+			opts->adaptive_bitrate);
+	obs_data_setint(settings, "retry_delay", 1);
+
+	if (multi)
+		set_destinations(settings, sinks, opts->destinations);
+
+	output = obs_output_create(multi ? "rtmp_multi_output" : "rtmp_output",
+			"bench output", settings);
+	obs_data_release(settings);
+
+	if (!output)
+		return NULL;
+
+	obs_output_set_video_encoder(output, venc);
+	obs_output_set_audio_encoder(output, aenc);
+	if (!multi)
+		obs_output_set_service(output, service);
+
+	signal_handler_connect(obs_output_signalhandler(output), "stop",
+			output_stopped, NULL);
+	return output;
+}
+
+static obs_encoder_t create_encoder(const char *id, int bitrate, int keyint)
+{
+	obs_data_t    settings = obs_data_create();
+	obs_encoder_t encoder;
+
+	obs_data_setint(settings, "bitrate", bitrate);
+	obs_data_setint(settings, "keyint", keyint);
+
+	encoder = (strcmp(id, "bench_video") == 0) ?
+		obs_video_encoder_create(id, id, settings) :
+		obs_audio_encoder_create(id, id, settings);
+
+	obs_data_release(settings);
+	return encoder;
+}
+
+static obs_service_t create_service(rtmp_sink_t sink)
+{
+	obs_data_t    settings = obs_data_create();
+	obs_service_t service;
+	char          url[64];
+
+	snprintf(url, sizeof(url), "rtmp://127.0.0.1:%d/live",
+			rtmp_sink_port(sink));
+	obs_data_setstring(settings, "url", url);
+
+	service = obs_service_create("bench_service", "bench", settings);
+	obs_data_release(settings);
+	return service;
+}
+
+static void wait_for_sink(rtmp_sink_t sink)
+{
+	struct rtmp_sink_stats stats;
+	uint64_t               start = os_gettime_ns();
+
+	do {
+		os_sleep_ms(50);
+		rtmp_sink_get_stats(sink, &stats);
+	} while (stats.publishing &&
+	         os_gettime_ns() - start < DRAIN_TIMEOUT_MS * 1000000ULL);
+}
+
+static int run_bench(struct bench_options *opts)
+{
+	struct video_output_info voi = {
+		.name     = "bench video",
+		.format   = VIDEO_FORMAT_I420,
+		.fps_num  = (uint32_t)opts->fps,
+		.fps_den  = 1,
+		.width    = BENCH_WIDTH,
+		.height   = BENCH_HEIGHT
+	};
+	struct audio_output_info aoi = {
+		.name            = "bench audio",
+		.samples_per_sec = BENCH_SAMPLE_RATE,
+		.format          = AUDIO_FORMAT_FLOAT_PLANAR,
+		.speakers        = SPEAKERS_STEREO,
+		.buffer_ms       = 100
+	};
+	struct frame_source    source  = {0};
+	struct rtmp_sink_stats stats   = {0};
+	video_t                video   = NULL;
+	audio_t                audio   = NULL;
+	rtmp_sink_t            sinks[MAX_DESTINATIONS] = {0};
+	long long              dropped[MAX_DESTINATIONS] = {0};
+	rtmp_sink_t            sink    = NULL;
+	uint64_t               sink_cpu_ns = 0;
+	obs_encoder_t          venc    = NULL;
+	obs_encoder_t          aenc    = NULL;
+	obs_service_t          service = NULL;
+	obs_output_t           output  = NULL;
+	uint64_t               start_ns, start_cpu_ns, last_bytes = 0;
+	int                    ret = 1;
+
+	for (int i = 0; i < opts->destinations; i++) {
+		sinks[i] = rtmp_sink_create(0, i == 0 ? opts->limit_kbps : 0);
+		if (!sinks[i])
+			goto fail;
+	}
+
+	sink = sinks[0];
+
+	if (video_output_open(&video, &voi) != VIDEO_OUTPUT_SUCCESS ||
+	    audio_output_open(&audio, &aoi) != AUDIO_OUTPUT_SUCCESS) {
+		blog(LOG_ERROR, "Could not open the video/audio outputs");
+		goto fail;
+	}
+
+	if (!frame_source_start(&source, video))
+		goto fail;
+
+	venc    = create_encoder("bench_video", opts->bitrate,
+			opts->keyint_sec * opts->fps);
+	aenc    = create_encoder("bench_audio", opts->audio_bitrate, 0);
+	service = create_service(sink);
+	if (!venc || !aenc || !service)
+		goto fail;
+
+	obs_encoder_set_video(venc, video);
+	obs_encoder_set_audio(aenc, audio);
+
+	output = create_output(opts, venc, aenc, service, sinks);
+	if (!output)
+		goto fail;
+
+	start_ns     = os_gettime_ns();
+	start_cpu_ns = process_cpu_time_ns();
+
+	if (!obs_output_start(output)) {
+		blog(LOG_ERROR, "Could not start the output");
+		goto fail;
+	}
+
+	for (int sec = 1; sec <= opts->duration_sec; sec++) {
+		os_sleepto_ns(start_ns + sec * 1000000000ULL);
+
+		if (sec == opts->disconnect_sec)
+			rtmp_sink_disconnect(sink);
+
+		rtmp_sink_get_stats(sink, &stats);
+		print_progress(opts, sec, output, &stats, &last_bytes);
+
+		if (os_atomic_load_long(&output_stop_code) != -1) {
+			blog(LOG_ERROR, "The output stopped with code %ld",
+					os_atomic_load_long(&output_stop_code));
+			break;
+		}
+	}
+
+	/* destinations are destroyed when the multi-destination output
+	 * stops, so their stats have to be read before */
+	for (int i = 0; i < opts->destinations; i++)
+		dropped[i] = get_output_dropped(opts, output, i);
+
+	obs_output_stop(output);
+	for (int i = 0; i < opts->destinations; i++)
+		wait_for_sink(sinks[i]);
+
+	/* the sinks run in this process too, so none of their cpu time is
+	 * counted as the cost of sending */
+	for (int i = opts->destinations - 1; i >= 0; i--) {
+		rtmp_sink_get_stats(sinks[i], &stats);
+		sink_cpu_ns += stats.cpu_time_ns;
+
+		if (opts->destinations > 1)
+			print_destination(i, &stats, dropped[i]);
+	}
+
+	stats.cpu_time_ns = sink_cpu_ns;
+	print_results(opts, &stats, dropped[0],
+			os_gettime_ns() - start_ns,
+			process_cpu_time_ns() - start_cpu_ns);
+	ret = 0;
+
+fail:
+	/* encoders detach themselves from their outputs when destroyed, so
+	 * they have to go first */
+	obs_encoder_destroy(venc);
+	obs_encoder_destroy(aenc);
+	obs_output_destroy(output);
+	obs_service_destroy(service);
+	if (source.planes)
+		frame_source_stop(&source);
+	video_output_close(video);
+	audio_output_close(audio);
+	for (int i = 0; i < opts->destinations; i++)
+		rtmp_sink_destroy(sinks[i]);
+	return ret;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void print_usage(const char *name)
+{
+	printf("usage: %s [options]\n"
+	       "  --bitrate <kbps>          video bitrate (default 2500)\n"
+	       "  --audio-bitrate <kbps>    audio bitrate (default 160)\n"
+	       "  --fps <fps>               frame rate (default 30)\n"
+	       "  --keyint <sec>            keyframe interval (default 2)\n"
+	       "  --duration <sec>          length of the test (default 10)\n"
+	       "  --limit <kbps>            link bandwidth (default unlimited)\n"
+	       "  --drop-threshold <ms>     frame drop threshold "
+	                                   "(default 600)\n"
+	       "  --disconnect <sec>        drop the connection after <sec>\n"
+	       "  --destinations <count>    stream to <count> sinks with the "
+	                                   "multi-destination output\n"
+	       "  --low-latency             enable the low latency mode\n"
+	       "  --adaptive-bitrate        enable adaptive bitrate\n",
+	       name);
+}
+
+static bool parse_options(int argc, char *argv[], struct bench_options *opts)
+{
+	for (int i = 1; i < argc; i++) {
+		const char *arg   = argv[i];
+		const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		int        *dst   = NULL;
+
+		if (strcmp(arg, "--low-latency") == 0) {
+			opts->low_latency = true;
+			continue;
+		} else if (strcmp(arg, "--adaptive-bitrate") == 0) {
+			opts->adaptive_bitrate = true;
+			continue;
+		}
+
+		if      (strcmp(arg, "--bitrate") == 0)
+			dst = &opts->bitrate;
+		else if (strcmp(arg, "--audio-bitrate") == 0)
+			dst = &opts->audio_bitrate;
+		else if (strcmp(arg, "--fps") == 0)
+			dst = &opts->fps;
+		else if (strcmp(arg, "--keyint") == 0)
+			dst = &opts->keyint_sec;
+		else if (strcmp(arg, "--duration") == 0)
+			dst = &opts->duration_sec;
+		else if (strcmp(arg, "--limit") == 0)
+			dst = &opts->limit_kbps;
+		else if (strcmp(arg, "--drop-threshold") == 0)
+			dst = &opts->drop_threshold_ms;
+		else if (strcmp(arg, "--disconnect") == 0)
+			dst = &opts->disconnect_sec;
+		else if (strcmp(arg, "--destinations") == 0)
+			dst = &opts->destinations;
+
+		if (!dst || !value)
+			return false;
+
+		*dst = atoi(value);
+		i++;
+	}
+
+	return opts->bitrate > 0 && opts->fps > 0 && opts->keyint_sec > 0 &&
+		opts->duration_sec > 0 && opts->destinations > 0 &&
+		opts->destinations <= MAX_DESTINATIONS;
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_options opts = {
+		.bitrate           = 2500,
+		.audio_bitrate     = 160,
+		.fps               = 30,
+		.keyint_sec        = 2,
+		.duration_sec      = 10,
+		.drop_threshold_ms = 600,
+		.destinations      = 1
+	};
+	int ret;
+
+	if (!parse_options(argc, argv, &opts)) {
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	/* like the main program, so that writing to a connection that the
+	 * sink has closed fails instead of killing the process */
+	signal(SIGPIPE, SIG_IGN);
+
+	if (!obs_startup())
+		return 1;
+
+	obs_register_output(&rtmp_output_info);
+	obs_register_output(&rtmp_multi_output_info);
+	obs_register_service(&bench_service);
+	obs_register_encoder(&bench_video_encoder);
+	obs_register_encoder(&bench_audio_encoder);
+
+	ret = run_bench(&opts);
+
+	obs_shutdown();
+	blog(LOG_INFO, "Number of memory leaks: %ld", bnum_allocs());
+	return ret;
+}
@@ -0,0 +1,751 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <util/bmem.h>
+#include <util/base.h>
+#include <util/darray.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include "librtmp/amf.h"
+#include "rtmp-sink.h"
+
+#define HANDSHAKE_SIZE      1536
+#define DEFAULT_CHUNK_SIZE  128
+#define MAX_CHUNK_STREAMS   320
+#define MAX_MESSAGE_SIZE    (16 * 1024 * 1024)
+#define READ_BUFFER_SIZE    16384
+#define LIMITED_READ_SIZE   4096
+#define LIMITED_RCVBUF_SIZE 32768
+#define POLL_TIMEOUT_MS     100
+
+#define MSG_SET_CHUNK_SIZE  1
+#define MSG_AUDIO           8
+#define MSG_VIDEO           9
+#define MSG_COMMAND         20
+
+/* offset of the sink marker in a video message: the FLV video tag header
+ * (5 bytes), the NAL size (4 bytes) and the NAL header (1 byte) */
+#define MARKER_OFFSET       10
+#define MARKER_DIGITS       16
+
+struct chunk_stream {
+	uint32_t  timestamp;
+	uint32_t  length;
+	uint8_t   type;
+	uint32_t  stream_id;
+	bool      extended_ts;
+
+	uint8_t   *body;
+	uint32_t  received;
+};
+
+struct rtmp_sink {
+	int                    listen_socket;
+	int                    port;
+	int                    limit_kbps;
+
+	pthread_t              thread;
+	bool                   thread_active;
+	os_event_t             stop_event;
+	volatile bool          disconnect;
+
+	/* current client */
+	int                    socket;
+	uint8_t                read_buf[READ_BUFFER_SIZE];
+	size_t                 read_pos;
+	size_t                 read_len;
+	uint64_t               limit_start_ns;
+	uint64_t               limit_bytes;
+	uint32_t               chunk_size;
+	struct chunk_stream    streams[MAX_CHUNK_STREAMS];
+
+	pthread_mutex_t        mutex;
+	struct rtmp_sink_stats stats;
+	DARRAY(uint32_t)       latencies;
+};
+
+/* ------------------------------------------------------------------------- */
+
+static inline bool should_stop(struct rtmp_sink *sink)
+{
+	return os_event_try(sink->stop_event) != EAGAIN || sink->disconnect;
+}
+
+static inline uint64_t thread_cpu_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline bool wait_readable(struct rtmp_sink *sink)
+{
+	struct pollfd pfd = {sink->socket, POLLIN, 0};
+
+	while (!should_stop(sink)) {
+		int ret = poll(&pfd, 1, POLL_TIMEOUT_MS);
+		if (ret > 0)
+			return true;
+		if (ret < 0 && errno != EINTR)
+			return false;
+	}
+
+	return false;
+}
+
+/* reads at most limit_kbps, the rest of the data waits in the socket which
+ * makes the sender's socket buffer fill up the same way a slow link would */
+static inline void limit_rate(struct rtmp_sink *sink, size_t bytes)
+{
+	uint64_t allowed_ns;
+
+	sink->limit_bytes += bytes;
+	allowed_ns = sink->limit_bytes * 8000000ULL /
+		(uint64_t)sink->limit_kbps;
+
+	os_sleepto_ns(sink->limit_start_ns + allowed_ns);
+}
+
+static bool fill_buffer(struct rtmp_sink *sink)
+{
+	size_t  max_size = sink->limit_kbps ?
+		LIMITED_READ_SIZE : READ_BUFFER_SIZE;
+	ssize_t ret;
+
+	if (!wait_readable(sink))
+		return false;
+
+	ret = recv(sink->socket, sink->read_buf, max_size, 0);
+	if (ret <= 0)
+		return false;
+
+	sink->read_pos = 0;
+	sink->read_len = (size_t)ret;
+
+	if (sink->limit_kbps)
+		limit_rate(sink, (size_t)ret);
+
+	pthread_mutex_lock(&sink->mutex);
+	sink->stats.bytes_received += (uint64_t)ret;
+	sink->stats.cpu_time_ns     = thread_cpu_time_ns();
+	pthread_mutex_unlock(&sink->mutex);
+	return true;
+}
+
+static bool read_data(struct rtmp_sink *sink, void *data, size_t size)
+{
+	uint8_t *out = data;
+
+	while (size) {
+		size_t copy_size;
+
+		if (sink->read_pos == sink->read_len && !fill_buffer(sink))
+			return false;
+
+		copy_size = sink->read_len - sink->read_pos;
+		if (copy_size > size)
+			copy_size = size;
+
+		if (out) {
+			memcpy(out, sink->read_buf + sink->read_pos, copy_size);
+			out += copy_size;
+		}
+
+		sink->read_pos += copy_size;
+		size           -= copy_size;
+	}
+
+	return true;
+}
+
+static bool write_data(struct rtmp_sink *sink, const void *data, size_t size)
+{
+	const uint8_t *in = data;
+
+	while (size) {
+		ssize_t ret = send(sink->socket, in, size, 0);
+		if (ret <= 0)
+			return false;
+
+		in   += ret;
+		size -= (size_t)ret;
+	}
+
+	return true;
+}
+
+static inline uint32_t rb24(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+}
+
+static inline uint32_t rb32(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 24) | rb24(data + 1);
+}
+
+static inline void wb24(uint8_t *data, uint32_t val)
+{
+	data[0] = (uint8_t)(val >> 16);
+	data[1] = (uint8_t)(val >> 8);
+	data[2] = (uint8_t)val;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* sends a message on chunk stream 3, split in to default sized chunks */
+static bool send_message(struct rtmp_sink *sink, uint8_t type,
+		uint32_t stream_id, const char *body, size_t size)
+{
+	uint8_t header[12];
+	uint8_t continuation = 0xC3;
+
+	header[0] = 0x03;
+	wb24(header + 1, 0);
+	wb24(header + 4, (uint32_t)size);
+	header[7]  = type;
+	header[8]  = (uint8_t)stream_id;
+	header[9]  = (uint8_t)(stream_id >> 8);
+	header[10] = (uint8_t)(stream_id >> 16);
+	header[11] = (uint8_t)(stream_id >> 24);
+
+	if (!write_data(sink, header, sizeof(header)))
+		return false;
+
+	while (true) {
+		size_t chunk = size > DEFAULT_CHUNK_SIZE ?
+			DEFAULT_CHUNK_SIZE : size;
+
+		if (!write_data(sink, body, chunk))
+			return false;
+
+		body += chunk;
+		size -= chunk;
+		if (!size)
+			break;
+
+		if (!write_data(sink, &continuation, 1))
+			return false;
+	}
+
+	return true;
+}
+
+static const AVal av_result       = AVC("_result");
+static const AVal av_onStatus     = AVC("onStatus");
+static const AVal av_connect      = AVC("connect");
+static const AVal av_createStream = AVC("createStream");
+static const AVal av_publish      = AVC("publish");
+static const AVal av_fmsVer       = AVC("fmsVer");
+static const AVal av_fmsVer_val   = AVC("FMS/3,0,1,123");
+static const AVal av_capabilities = AVC("capabilities");
+static const AVal av_level        = AVC("level");
+static const AVal av_status       = AVC("status");
+static const AVal av_code         = AVC("code");
+static const AVal av_description  = AVC("description");
+static const AVal av_connected    = AVC("NetConnection.Connect.Success");
+static const AVal av_publishing   = AVC("NetStream.Publish.Start");
+static const AVal av_started      = AVC("Started publishing");
+
+static inline char *encode_status(char *enc, char *end, const AVal *code,
+		const AVal *description)
+{
+	*enc++ = AMF_OBJECT;
+	enc = AMF_EncodeNamedString(enc, end, &av_level, &av_status);
+	enc = AMF_EncodeNamedString(enc, end, &av_code, code);
+	enc = AMF_EncodeNamedString(enc, end, &av_description, description);
+	enc = AMF_EncodeInt24(enc, end, AMF_OBJECT_END);
+	return enc;
+}
+
+static bool send_connect_result(struct rtmp_sink *sink, double txn)
+{
+	char buf[512], *end = buf + sizeof(buf);
+	char *enc = buf;
+
+	enc = AMF_EncodeString(enc, end, &av_result);
+	enc = AMF_EncodeNumber(enc, end, txn);
+	*enc++ = AMF_OBJECT;
+	enc = AMF_EncodeNamedString(enc, end, &av_fmsVer, &av_fmsVer_val);
+	enc = AMF_EncodeNamedNumber(enc, end, &av_capabilities, 31.0);
+	enc = AMF_EncodeInt24(enc, end, AMF_OBJECT_END);
+	enc = encode_status(enc, end, &av_connected, &av_connected);
+
+	return send_message(sink, MSG_COMMAND, 0, buf, enc - buf);
+}
+
+static bool send_create_stream_result(struct rtmp_sink *sink, double txn)
+{
+	char buf[128], *end = buf + sizeof(buf);
+	char *enc = buf;
+
+	enc = AMF_EncodeString(enc, end, &av_result);
+	enc = AMF_EncodeNumber(enc, end, txn);
+	*enc++ = AMF_NULL;
+	enc = AMF_EncodeNumber(enc, end, 1.0);
+
+	return send_message(sink, MSG_COMMAND, 0, buf, enc - buf);
+}
+
+static bool send_publish_status(struct rtmp_sink *sink)
+{
+	char buf[512], *end = buf + sizeof(buf);
+	char *enc = buf;
+
+	enc = AMF_EncodeString(enc, end, &av_onStatus);
+	enc = AMF_EncodeNumber(enc, end, 0.0);
+	*enc++ = AMF_NULL;
+	enc = encode_status(enc, end, &av_publishing, &av_started);
+
+	return send_message(sink, MSG_COMMAND, 1, buf, enc - buf);
+}
+
+static bool handle_command(struct rtmp_sink *sink, struct chunk_stream *cs)
+{
+	AMFObject obj;
+	AVal      method = {0};
+	double    txn;
+	bool      success = true;
+
+	if (AMF_Decode(&obj, (char*)cs->body, (int)cs->length, false) < 0)
+		return false;
+
+	AMFProp_GetString(AMF_GetProp(&obj, NULL, 0), &method);
+	txn = AMFProp_GetNumber(AMF_GetProp(&obj, NULL, 1));
+
+	if (AVMATCH(&method, &av_connect)) {
+		success = send_connect_result(sink, txn);
+
+	} else if (AVMATCH(&method, &av_createStream)) {
+		success = send_create_stream_result(sink, txn);
+
+	} else if (AVMATCH(&method, &av_publish)) {
+		success = send_publish_status(sink);
+
+		pthread_mutex_lock(&sink->mutex);
+		sink->stats.publishing = true;
+		pthread_mutex_unlock(&sink->mutex);
+	}
+
+	AMF_Reset(&obj);
+	return success;
+}
+
+static inline bool parse_marker(const uint8_t *data, size_t size,
+		uint64_t *timestamp)
+{
+	uint64_t val = 0;
+
+	if (size < MARKER_OFFSET + RTMP_SINK_MARKER_SIZE + MARKER_DIGITS)
+		return false;
+
+	data += MARKER_OFFSET;
+	if (memcmp(data, RTMP_SINK_MARKER, RTMP_SINK_MARKER_SIZE) != 0)
+		return false;
+
+	data += RTMP_SINK_MARKER_SIZE;
+	for (int i = 0; i < MARKER_DIGITS; i++) {
+		uint8_t c = data[i];
+		uint8_t digit;
+
+		if (c >= '0' && c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' && c <= 'f')
+			digit = c - 'a' + 10;
+		else
+			return false;
+
+		val = (val << 4) | digit;
+	}
+
+	*timestamp = val;
+	return true;
+}
+
+static void handle_video(struct rtmp_sink *sink, struct chunk_stream *cs)
+{
+	uint64_t sent_ns;
+	bool     marked;
+
+	/* skip the sequence header, only count frame data */
+	if (cs->length < 2 || cs->body[1] != 1)
+		return;
+
+	marked = parse_marker(cs->body, cs->length, &sent_ns);
+
+	pthread_mutex_lock(&sink->mutex);
+
+	sink->stats.video_frames++;
+	if ((cs->body[0] >> 4) == 1)
+		sink->stats.keyframes++;
+
+	if (marked) {
+		uint64_t latency_us = (os_gettime_ns() - sent_ns) / 1000;
+		uint32_t val = latency_us > UINT32_MAX ?
+			UINT32_MAX : (uint32_t)latency_us;
+		da_push_back(sink->latencies, &val);
+	}
+
+	pthread_mutex_unlock(&sink->mutex);
+}
+
+static void handle_audio(struct rtmp_sink *sink, struct chunk_stream *cs)
+{
+	if (cs->length < 2 || cs->body[1] != 1)
+		return;
+
+	pthread_mutex_lock(&sink->mutex);
+	sink->stats.audio_frames++;
+	pthread_mutex_unlock(&sink->mutex);
+}
+
+static bool handle_message(struct rtmp_sink *sink, struct chunk_stream *cs)
+{
+	switch (cs->type) {
+	case MSG_SET_CHUNK_SIZE:
+		if (cs->length < 4)
+			return false;
+		sink->chunk_size = rb32(cs->body) & 0x7FFFFFFF;
+		return sink->chunk_size != 0;
+
+	case MSG_COMMAND:
+		return handle_command(sink, cs);
+
+	case MSG_VIDEO:
+		handle_video(sink, cs);
+		break;
+
+	case MSG_AUDIO:
+		handle_audio(sink, cs);
+		break;
+	}
+
+	return true;
+}
+
+/* reads one chunk, and handles its message if the chunk completes it */
+static bool read_chunk(struct rtmp_sink *sink)
+{
+	static const size_t header_sizes[] = {11, 7, 3, 0};
+	struct chunk_stream *cs;
+	uint8_t  header[11];
+	uint8_t  byte;
+	uint32_t csid;
+	uint32_t chunk;
+	int      fmt;
+
+	if (!read_data(sink, &byte, 1))
+		return false;
+
+	fmt  = byte >> 6;
+	csid = byte & 0x3F;
+
+	if (csid == 0) {
+		if (!read_data(sink, header, 1))
+			return false;
+		csid = 64 + header[0];
+
+	} else if (csid == 1) {
+		if (!read_data(sink, header, 2))
+			return false;
+		csid = 64 + header[0] + ((uint32_t)header[1] << 8);
+	}
+
+	if (csid >= MAX_CHUNK_STREAMS) {
+		blog(LOG_WARNING, "rtmp-sink: unsupported chunk stream %u",
+				csid);
+		return false;
+	}
+
+	cs = sink->streams + csid;
+	if (!read_data(sink, header, header_sizes[fmt]))
+		return false;
+
+	if (fmt <= 2) {
+		uint32_t ts = rb24(header);
+		cs->extended_ts = (ts == 0xFFFFFF);
+		cs->timestamp   = (fmt == 0) ? ts : cs->timestamp + ts;
+	}
+	if (fmt <= 1) {
+		if (cs->received) {
+			blog(LOG_WARNING, "rtmp-sink: new message header in "
+			                  "the middle of a message");
+			return false;
+		}
+
+		cs->length = rb24(header + 3);
+		cs->type   = header[6];
+	}
+	if (fmt == 0) {
+		cs->stream_id = header[7] | ((uint32_t)header[8] << 8) |
+			((uint32_t)header[9] << 16) |
+			((uint32_t)header[10] << 24);
+	}
+
+	/* librtmp only writes the extended timestamp after full headers, not
+	 * after the headers of continuation chunks */
+	if (fmt <= 2 && cs->extended_ts && !read_data(sink, header, 4))
+		return false;
+
+	if (cs->length > MAX_MESSAGE_SIZE) {
+		blog(LOG_WARNING, "rtmp-sink: message too large (%u bytes)",
+				cs->length);
+		return false;
+	}
+
+	if (!cs->received)
+		cs->body = brealloc(cs->body, cs->length ? cs->length : 1);
+
+	chunk = cs->length - cs->received;
+	if (chunk > sink->chunk_size)
+		chunk = sink->chunk_size;
+
+	if (!read_data(sink, cs->body + cs->received, chunk))
+		return false;
+
+	cs->received += chunk;
+	if (cs->received < cs->length)
+		return true;
+
+	cs->received = 0;
+	return handle_message(sink, cs);
+}
+
+static bool handshake(struct rtmp_sink *sink)
+{
+	uint8_t c0, s0 = 3;
+	uint8_t c1[HANDSHAKE_SIZE];
+	uint8_t s1[HANDSHAKE_SIZE] = {0};
+
+	if (!read_data(sink, &c0, 1) || !read_data(sink, c1, HANDSHAKE_SIZE))
+		return false;
+
+	/* S2 echoes C1 back, so that the client accepts it */
+	if (!write_data(sink, &s0, 1) ||
+	    !write_data(sink, s1, HANDSHAKE_SIZE) ||
+	    !write_data(sink, c1, HANDSHAKE_SIZE))
+		return false;
+
+	return read_data(sink, NULL, HANDSHAKE_SIZE);
+}
+
+static void reset_client(struct rtmp_sink *sink, int socket)
+{
+	sink->socket         = socket;
+	sink->read_pos       = 0;
+	sink->read_len       = 0;
+	sink->limit_start_ns = os_gettime_ns();
+	sink->limit_bytes    = 0;
+	sink->chunk_size     = DEFAULT_CHUNK_SIZE;
+	sink->disconnect     = false;
+
+	for (size_t i = 0; i < MAX_CHUNK_STREAMS; i++) {
+		bfree(sink->streams[i].body);
+		memset(sink->streams + i, 0, sizeof(struct chunk_stream));
+	}
+}
+
+static void handle_client(struct rtmp_sink *sink, int socket)
+{
+	reset_client(sink, socket);
+
+	pthread_mutex_lock(&sink->mutex);
+	sink->stats.connections++;
+	pthread_mutex_unlock(&sink->mutex);
+
+	if (handshake(sink))
+		while (read_chunk(sink));
+
+	pthread_mutex_lock(&sink->mutex);
+	sink->stats.publishing = false;
+	pthread_mutex_unlock(&sink->mutex);
+
+	close(socket);
+	reset_client(sink, -1);
+}
+
+static void *sink_thread(void *data)
+{
+	struct rtmp_sink *sink = data;
+	struct pollfd    pfd   = {sink->listen_socket, POLLIN, 0};
+
+	while (os_event_try(sink->stop_event) == EAGAIN) {
+		int socket;
+
+		if (poll(&pfd, 1, POLL_TIMEOUT_MS) <= 0)
+			continue;
+
+		socket = accept(sink->listen_socket, NULL, NULL);
+		if (socket >= 0)
+			handle_client(sink, socket);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static bool init_listen_socket(struct rtmp_sink *sink, int port)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t          len  = sizeof(addr);
+	int                on   = 1;
+
+	sink->listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (sink->listen_socket < 0)
+		return false;
+
+	setsockopt(sink->listen_socket, SOL_SOCKET, SO_REUSEADDR, &on,
+			sizeof(on));
+
+	/* the receive buffer size of accepted sockets is inherited from the
+	 * listening socket, and has to be set before the connection is made
+	 * for the window to stay small */
+	if (sink->limit_kbps) {
+		int size = LIMITED_RCVBUF_SIZE;
+		setsockopt(sink->listen_socket, SOL_SOCKET, SO_RCVBUF, &size,
+				sizeof(size));
+	}
+
+	addr.sin_family      = AF_INET;
+	addr.sin_port        = htons((uint16_t)port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(sink->listen_socket, (struct sockaddr*)&addr,
+				sizeof(addr)) != 0)
+		return false;
+	if (listen(sink->listen_socket, 1) != 0)
+		return false;
+	if (getsockname(sink->listen_socket, (struct sockaddr*)&addr,
+				&len) != 0)
+		return false;
+
+	sink->port = ntohs(addr.sin_port);
+	return true;
+}
+
+rtmp_sink_t rtmp_sink_create(int port, int limit_kbps)
+{
+	struct rtmp_sink *sink = bzalloc(sizeof(struct rtmp_sink));
+
+	sink->listen_socket = -1;
+	sink->socket        = -1;
+	sink->limit_kbps    = limit_kbps;
+	pthread_mutex_init_value(&sink->mutex);
+
+	if (pthread_mutex_init(&sink->mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&sink->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+	if (!init_listen_socket(sink, port)) {
+		blog(LOG_ERROR, "rtmp-sink: could not listen on port %d",
+				port);
+		goto fail;
+	}
+	if (pthread_create(&sink->thread, NULL, sink_thread, sink) != 0)
+		goto fail;
+
+	sink->thread_active = true;
+	return sink;
+
+fail:
+	rtmp_sink_destroy(sink);
+	return NULL;
+}
+
+void rtmp_sink_destroy(rtmp_sink_t sink)
+{
+	if (!sink)
+		return;
+
+	if (sink->thread_active) {
+		os_event_signal(sink->stop_event);
+		pthread_join(sink->thread, NULL);
+	}
+
+	if (sink->listen_socket >= 0)
+		close(sink->listen_socket);
+
+	for (size_t i = 0; i < MAX_CHUNK_STREAMS; i++)
+		bfree(sink->streams[i].body);
+
+	da_free(sink->latencies);
+	os_event_destroy(sink->stop_event);
+	pthread_mutex_destroy(&sink->mutex);
+	bfree(sink);
+}
+
+int rtmp_sink_port(rtmp_sink_t sink)
+{
+	return sink ? sink->port : 0;
+}
+
+void rtmp_sink_disconnect(rtmp_sink_t sink)
+{
+	if (sink)
+		sink->disconnect = true;
+}
+
+static int compare_latencies(const void *a, const void *b)
+{
+	uint32_t val_a = *(const uint32_t*)a;
+	uint32_t val_b = *(const uint32_t*)b;
+	return (val_a > val_b) - (val_a < val_b);
+}
+
+void rtmp_sink_get_stats(rtmp_sink_t sink, struct rtmp_sink_stats *stats)
+{
+	DARRAY(uint32_t) latencies;
+	uint64_t total = 0;
+
+	if (!sink)
+		return;
+
+	pthread_mutex_lock(&sink->mutex);
+	*stats = sink->stats;
+	da_init(latencies);
+	da_copy(latencies, sink->latencies);
+	pthread_mutex_unlock(&sink->mutex);
+
+	stats->latency_frames = latencies.num;
+	if (!latencies.num)
+		return;
+
+	qsort(latencies.array, latencies.num, sizeof(uint32_t),
+			compare_latencies);
+
+	for (size_t i = 0; i < latencies.num; i++)
+		total += latencies.array[i];
+
+	stats->latency_avg_us = total / latencies.num;
+	stats->latency_p50_us = latencies.array[latencies.num / 2];
+	stats->latency_p95_us = latencies.array[latencies.num * 95 / 100];
+	stats->latency_max_us = latencies.array[latencies.num - 1];
+
+	da_free(latencies);
+}
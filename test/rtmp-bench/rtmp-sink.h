@@ -0,0 +1,87 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Minimal RTMP receiving server for testing the RTMP output locally.  It
+ * accepts one publishing client at a time on 127.0.0.1, answers just enough
+ * of the connect/createStream/publish commands for librtmp to start
+ * publishing, and then consumes and counts the audio/video messages.
+ *
+ * Video frames may carry a send timestamp (see RTMP_SINK_MARKER) right
+ * after the NAL header of their first NAL unit, which is used to measure
+ * the latency from the encoder to the sink.
+ *
+ * Like librtmp, the sink expects SIGPIPE to be ignored by the process.
+ */
+
+/** Marker that precedes the 16 hex digit os_gettime_ns() send timestamp */
+#define RTMP_SINK_MARKER      "OBSTS"
+#define RTMP_SINK_MARKER_SIZE 5
+
+struct rtmp_sink_stats {
+	uint64_t bytes_received;
+	uint64_t video_frames;
+	uint64_t audio_frames;
+	uint64_t keyframes;
+	int      connections;
+	bool     publishing;
+
+	/* latency of the marked video frames, in microseconds */
+	uint64_t latency_frames;
+	uint64_t latency_avg_us;
+	uint64_t latency_p50_us;
+	uint64_t latency_p95_us;
+	uint64_t latency_max_us;
+
+	/* cpu time used by the sink thread */
+	uint64_t cpu_time_ns;
+};
+
+struct rtmp_sink;
+typedef struct rtmp_sink *rtmp_sink_t;
+
+/**
+ * Starts listening on 127.0.0.1.
+ *
+ * @param  port        Port to listen on, or 0 to use any free port
+ * @param  limit_kbps  Rate at which data is read from the client, to
+ *                     simulate a limited link.  0 for no limit.
+ * @return             The sink, or NULL if it could not be started
+ */
+extern rtmp_sink_t rtmp_sink_create(int port, int limit_kbps);
+extern void rtmp_sink_destroy(rtmp_sink_t sink);
+
+/** Returns the port the sink is listening on */
+extern int rtmp_sink_port(rtmp_sink_t sink);
+
+/** Disconnects the current client, e.g. to test reconnecting */
+extern void rtmp_sink_disconnect(rtmp_sink_t sink);
+
+extern void rtmp_sink_get_stats(rtmp_sink_t sink,
+		struct rtmp_sink_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif